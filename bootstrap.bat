@@ -26,6 +26,14 @@
 @call %IMP_SOURCE_HOME%\compiler\make_compiler bootstrap
 @call %IMP_SOURCE_HOME%\compiler\make_compiler install
 
+@rem the .ibj files are snapshots made from earlier sources (and there
+@rem is none for the optimiser), so the compiler just made rebuilds the
+@rem run-time library and then itself from the sources
+@call %IMP_SOURCE_HOME%\lib\make_lib rebuild
+@call %IMP_SOURCE_HOME%\lib\make_lib install
+@call %IMP_SOURCE_HOME%\compiler\make_compiler rebuild
+@call %IMP_SOURCE_HOME%\compiler\make_compiler install
+
 @call %IMP_SOURCE_HOME%\compiler\make_compiler clean
 @call %IMP_SOURCE_HOME%\lib\make_lib           clean
 @call %IMP_SOURCE_HOME%\pass3\make_pass3       clean
@@ -50,6 +50,19 @@ make bootstrap
 cd ${IMP_SOURCE_HOME}/compiler
 make bootstrap
 
+# The .ibj snapshots are older than the sources, so what was built from
+# them only serves to compile the run time and the compiler again from
+# their sources.  The second time round it is the new compiler which
+# compiles them, and the fresh snapshots it leaves are the ones to keep
+for stage in 2 3; do
+    echo "Bootstrap stage ${stage}"
+    cd ${IMP_SOURCE_HOME}/lib
+    make bootstrap2
+
+    cd ${IMP_SOURCE_HOME}/compiler
+    make bootstrap2
+done
+
 cd ${IMP_SOURCE_HOME}/pass3
 make clean
 
@@ -0,0 +1,165 @@
+#! /bin/bash
+# Compiler self-host throughput benchmark
+#
+# Compiles the compiler's own sources (pass2_intel.imp, pass1_i77.imp)
+# and the run time library modules several times with impdriver, and
+# reports the time each pass took and the lines compiled per second.
+# The time of each pass, and the total, are compared with a stored
+# baseline, and the benchmark fails if any has grown by more than its
+# threshold.
+#
+# Usage: benchmark.sh [-b]
+#    -b  keep this run as the new baseline
+#
+# Environment:
+#    BENCH_RUNS       compiles of each source, the quickest counting (3)
+#    BENCH_THRESHOLD  percentage slower than the baseline allowed (10)
+#    BENCH_PASS_THRESHOLD  the same, for each pass (BENCH_THRESHOLD)
+#    BENCH_SLACK      milliseconds any time may grow by regardless (20),
+#                     so that the quick passes are not failed on noise
+#    BENCH_BASELINE   the baseline file (benchmark.baseline)
+#    BENCH_DRIVER     the impdriver to time (the one in this directory)
+#
+# The times are those impdriver reports with IMP_DIAGNOSE=128.  The
+# processor time is compared, as it varies less than the real time.
+
+PROGNAME=`basename $0`
+HERE=`dirname \`realpath $0\``
+TREE=`dirname ${HERE}`
+
+RUNS=${BENCH_RUNS:-3}
+THRESHOLD=${BENCH_THRESHOLD:-10}
+PASS_THRESHOLD=${BENCH_PASS_THRESHOLD:-${THRESHOLD}}
+SLACK=${BENCH_SLACK:-20}
+BASELINE=${BENCH_BASELINE:-${HERE}/benchmark.baseline}
+DRIVER=`realpath ${BENCH_DRIVER:-${HERE}/impdriver}`
+PERM_FILE=${TREE}/lib/stdperm.imp
+
+KEEP_BASELINE=false
+if [[ "$1" == "-b" ]]; then
+    KEEP_BASELINE=true
+fi
+
+if [ ! -x ${DRIVER} ]; then
+    echo "${PROGNAME}: No impdriver at ${DRIVER}" 1>&2
+    exit 1
+fi
+
+# The sources are compiled in a copy of the tree, so that nothing in
+# the tree itself is overwritten
+WORK=`mktemp -d ${TMPDIR:-/tmp}/impbench.XXXXXX`
+trap "rm -rf ${WORK}" EXIT
+cp -r ${TREE}/compiler ${TREE}/lib ${WORK}
+# pass1's snapshot of the perm is kept here, so that only the first
+# compile analyses the perm
+export IMPPRELUDE=${WORK}
+export IMP_DIAGNOSE=128
+
+SOURCES="compiler/pass2_intel.imp compiler/pass1_i77.imp"
+for f in ${TREE}/lib/*.imp
+do
+    case `basename $f` in
+    stdperm.imp) ;;
+    *) SOURCES="${SOURCES} lib/`basename $f`" ;;
+    esac
+done
+
+# The quickest of the runs of one source, as
+#    <pass1> <optimise> <pass2> <pass3> <total> <real total>
+# in milliseconds
+time_source()
+{
+    local dir=`dirname $1` src=`basename $1`
+    local run best= times
+
+    for (( run = 0; run < ${RUNS}; run++ ))
+    do
+        times=`cd ${WORK}/${dir} && ${DRIVER} ${PERM_FILE} ${src} pass1pass2pass3 2>&1 | awk '
+            /^#Faults= *[1-9]/ { faulty = 1 }
+            /^#Time / {
+                split($0, f, /[= ,]+/)
+                sub(/ms$/, "", f[3]); sub(/ms$/, "", f[5])
+                cpu[f[2]] = f[3]; total += f[3]; real += f[5]
+            }
+            END {
+                if (faulty || total == "") exit 1
+                printf "%d %d %d %d %d %d\n", cpu["pass1"], cpu["optimise"], cpu["pass2"], cpu["pass3"], total, real
+            }'`
+        if [ $? -ne 0 ]; then
+            echo "${PROGNAME}: ${src} did not compile" 1>&2
+            return 1
+        fi
+        if [ -z "${best}" ] || [ `echo ${times} | cut -d' ' -f5` -lt `echo ${best} | cut -d' ' -f5` ]; then
+            best=${times}
+        fi
+    done
+    echo ${best}
+}
+
+# lines per second from lines and milliseconds
+rate()
+{
+    if [ $2 -gt 0 ]; then
+        echo $(( $1 * 1000 / $2 ))
+    else
+        echo "-"
+    fi
+}
+
+RESULTS=${WORK}/results
+: > ${RESULTS}
+printf "%-24s %7s %7s %7s %7s %7s %7s %7s %9s\n" source lines pass1 optim pass2 pass3 cpu real "lines/s"
+for s in ${SOURCES}
+do
+    lines=`wc -l < ${WORK}/$s`
+    times=`time_source $s` || exit 1
+    set -- ${times}
+    printf "%-24s %7d %7d %7d %7d %7d %7d %7d %9s\n" `basename $s` ${lines} $1 $2 $3 $4 $5 $6 `rate ${lines} $5`
+    echo "`basename $s` ${lines} ${times}" >> ${RESULTS}
+done
+
+# Totals, and the throughput of the whole compile and of pass3 alone
+set -- `awk '{ l += $2; p1 += $3; o += $4; p2 += $5; p3 += $6; t += $7; r += $8 }
+             END { print l, p1, o, p2, p3, t, r }' ${RESULTS}`
+NOW="$2 $3 $4 $5 $6"
+printf "%-24s %7d %7d %7d %7d %7d %7d %7d %9s\n" total $1 $2 $3 $4 $5 $6 $7 `rate $1 $6`
+echo "impdriver: `rate $1 $6` lines/s cpu, `rate $1 $7` lines/s real"
+echo "pass3:     `rate $1 $5` lines/s cpu"
+echo "(times in ms of cpu, the quickest of ${RUNS} runs)"
+
+if ${KEEP_BASELINE}; then
+    cp ${RESULTS} ${BASELINE}
+    echo "${PROGNAME}: baseline kept in ${BASELINE}"
+    exit 0
+fi
+
+if [ ! -f ${BASELINE} ]; then
+    echo "${PROGNAME}: no baseline to compare with (make one with -b)"
+    exit 0
+fi
+
+# The baseline's totals, in the same order, and each compared in turn
+set -- `awk '{ p1 += $3; o += $4; p2 += $5; p3 += $6; t += $7 }
+             END { print p1, o, p2, p3, t }' ${BASELINE}`
+BASE="$*"
+set -- ${NOW}
+NOW_PASS1=$1; NOW_OPTIM=$2; NOW_PASS2=$3; NOW_PASS3=$4; NOW_CPU=$5
+set -- ${BASE}
+echo "baseline:  pass1 $1ms, optimise $2ms, pass2 $3ms, pass3 $4ms, cpu $5ms"
+echo "now:       pass1 ${NOW_PASS1}ms, optimise ${NOW_OPTIM}ms, pass2 ${NOW_PASS2}ms, pass3 ${NOW_PASS3}ms, cpu ${NOW_CPU}ms"
+
+SLOWER=0
+# slower <what> <baseline> <now> <threshold>
+slower()
+{
+    if [ $(( $3 * 100 )) -gt $(( $2 * (100 + $4) )) ] && [ $(( $3 - $2 )) -gt ${SLACK} ]; then
+        echo "${PROGNAME}: $1 time is more than $4% over the baseline" 1>&2
+        SLOWER=1
+    fi
+}
+slower pass1 $1 ${NOW_PASS1} ${PASS_THRESHOLD}
+slower optimise $2 ${NOW_OPTIM} ${PASS_THRESHOLD}
+slower pass2 $3 ${NOW_PASS2} ${PASS_THRESHOLD}
+slower pass3 $4 ${NOW_PASS3} ${PASS_THRESHOLD}
+slower compile $5 ${NOW_CPU} ${THRESHOLD}
+exit ${SLOWER}
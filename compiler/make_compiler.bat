@@ -89,9 +89,10 @@
 
 :do_makecompiler
 @set start=%1
+@call :do_optimiser %start%
 
 @rem compile the utility code
-@for %%a in (takeon,ibj.utils,icd.utils,buffer,incfile,impdriver) do (
+@for %%a in (takeon,ibj.utils,icd.utils,%OPTIMISER%,buffer,incfile,impdriver) do (
     @call :do_compile "%%a" %start%
 )
 @call :do_link takeon
@@ -106,14 +107,15 @@
     @call :do_compile "%%a" %start%
 )
 
-@call :do_link impdriver pass1_i77 pass2_intel buffer incfile icd.utils ibj.utils
+@call :do_link impdriver pass1_i77 pass2_intel buffer incfile icd.utils %OPTIMISER% ibj.utils
 @exit/b
 
 :do_pass1
 @set start=%1
+@call :do_optimiser %start%
 
 @rem compile the utility code
-@for %%a in (takeon,ibj.utils,icd.utils,buffer,incfile,pass1driver) do (
+@for %%a in (takeon,ibj.utils,icd.utils,%OPTIMISER%,buffer,incfile,pass1driver) do (
     @call :do_compile "%%a" %start%
 )
 @call :do_link takeon
@@ -128,14 +130,15 @@
     @call :do_compile "%%a" %start%
 )
 
-@call :do_link pass1driver pass1_i77 pass2_intel buffer incfile icd.utils ibj.utils
+@call :do_link pass1driver pass1_i77 pass2_intel buffer incfile icd.utils %OPTIMISER% ibj.utils
 @exit/b
 
 :do_pass2
 @set start=%1
+@call :do_optimiser %start%
 
 @rem compile the utility code
-@for %%a in (takeon,ibj.utils,icd.utils,buffer,incfile,pass2driver) do (
+@for %%a in (takeon,ibj.utils,icd.utils,%OPTIMISER%,buffer,incfile,pass2driver) do (
     @call :do_compile "%%a" %start%
 )
 @call :do_link takeon
@@ -150,7 +153,16 @@
     @call :do_compile "%%a" %start%
 )
 
-@call :do_link pass2driver pass1_i77 pass2_intel buffer incfile icd.utils ibj.utils
+@call :do_link pass2driver pass1_i77 pass2_intel buffer incfile icd.utils %OPTIMISER% ibj.utils
+@exit/b
+
+:do_optimiser
+@rem The .ibj files are snapshots made from earlier sources, and there
+@rem is none for the optimiser (icd.optimise), so a bootstrap from them
+@rem leaves it out.  The compiler it makes can then rebuild from the
+@rem sources, optimiser and all
+@set OPTIMISER=
+@if "%1"=="imp" @set OPTIMISER=icd.optimise
 @exit/b
 
 :do_compile
@@ -167,20 +179,15 @@
 @rem Ensure we have a clean library
 @if exist %COMPILER_LIB% del %COMPILER_LIB%
 
-@set file1=%1
-@set file2=%2
-@set file3=%3
-@set file4=%4
-@set file5=%5
-@set file6=%6
-@set file7=%7
-@if not "%file1%"=="" @lib /nologo /out:%COMPILER_LIB% %file1%.obj
-@if not "%file2%"=="" @lib /nologo /out:%COMPILER_LIB% %COMPILER_LIB% %file2%.obj
-@if not "%file3%"=="" @lib /nologo /out:%COMPILER_LIB% %COMPILER_LIB% %file3%.obj
-@if not "%file4%"=="" @lib /nologo /out:%COMPILER_LIB% %COMPILER_LIB% %file4%.obj
-@if not "%file5%"=="" @lib /nologo /out:%COMPILER_LIB% %COMPILER_LIB% %file5%.obj
-@if not "%file6%"=="" @lib /nologo /out:%COMPILER_LIB% %COMPILER_LIB% %file6%.obj
-@if not "%file7%"=="" @lib /nologo /out:%COMPILER_LIB% %COMPILER_LIB% %file7%.obj
+@rem the program, then however many modules go with it
+@set program=%1
+@lib /nologo /out:%COMPILER_LIB% %program%.obj
+:do_link_next
+@shift
+@if "%1"=="" @goto do_link_program
+@lib /nologo /out:%COMPILER_LIB% %COMPILER_LIB% %1.obj
+@goto do_link_next
+:do_link_program
 
 @rem This link command line adds the C heap library code
 @rem To exclude the heap code
@@ -190,9 +197,10 @@
 @rem set HEAP_REQUEST=
 @set HEAP_REQUEST=/heap:0x800000,0x800000
 @link /nologo /SUBSYSTEM:CONSOLE /stack:0x800000,0x800000 %HEAP_REQUEST% ^
-/MAPINFO:EXPORTS /MAP:%1.map /OUT:%1.exe ^
+/MAPINFO:EXPORTS /MAP:%program%.map /OUT:%program%.exe ^
 /DEFAULTLIB:%LIB_HOME%\libi77.lib %LIB_HOME%\imprtl-main.obj ^
 %COMPILER_LIB% ^
+%LIB_HOME%\pass3lib.lib ^
 %LIB_HOME%\libi77.lib
 
 @exit/b
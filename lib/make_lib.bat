@@ -30,8 +30,12 @@
 @echo "LIBRARY BOOTSTRAP requested"
 @echo.
 :do_bootstrap
-@rem create the libi77 library from the only C source module
+@rem create the libi77 library from the C source modules
 @call :do_createlib prim-rtl-file -DMSVC
+@call :do_addclib    prim-rtl-prof -DMSVC
+@call :do_addclib    prim-rtl-thread -DMSVC
+@call :do_addclib    prim-rtl-serve -DMSVC
+@call :do_addclib    prim-rtl-time -DMSVC
 @rem compile the IMP inteface module
 @call :do_compile   imprtl-main   ibj  nolib
 @rem start with the imp run-time module ibj files
@@ -45,8 +49,12 @@
 @echo "LIBRARY REBUILD requested"
 @echo.
 :do_rebuild
-@rem create the libi77 library from the only C source module
+@rem create the libi77 library from the C source modules
 @call :do_createlib prim-rtl-file -DMSVC
+@call :do_addclib    prim-rtl-prof -DMSVC
+@call :do_addclib    prim-rtl-thread -DMSVC
+@call :do_addclib    prim-rtl-serve -DMSVC
+@call :do_addclib    prim-rtl-time -DMSVC
 @rem compile the IMP inteface module
 @call :do_compile   imprtl-main   imp  nolib
 @rem start with the imp run-time module imp source files
@@ -168,6 +176,17 @@
 @lib /nologo /out:%LIB_FILE% %module%.obj
 @exit/b
 
+:do_addclib
+@rem add the other C source primitives to the library made by do_createlib
+@set module=%1
+@set option=%2
+
+@cl /nologo /Gd /c /Gs /W3 /Od /arch:IA32 -D_CRT_SECURE_NO_WARNINGS /FAscu ^
+%option% /Fo%module%.obj /Fa%module%.lst %module%.c
+
+@lib /nologo /out:%LIB_FILE% %LIB_FILE% %module%.obj
+@exit/b
+
 :do_compile
 @rem compile the specified IMP module
 @set module=%1
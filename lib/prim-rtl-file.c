@@ -29,3 +29,175 @@ FILE *getstdout()
 {
     return stdout;
 }
+
+#ifndef MSVC
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// Files a program keeps for itself between runs (pass1's prelude
+// snapshot) are opened through these, so that a file planted by
+// someone else is neither read nor written through.
+
+// Open a file for reading only if it is a plain file (not a link)
+// owned by this user, which no one else can write
+FILE *_imp_privateopen(char *name)
+{
+    struct stat s;
+    int fd;
+    FILE *f;
+
+    fd = open(name, O_RDONLY | O_NOFOLLOW);
+    if (fd < 0)
+        return NULL;
+    if ((fstat(fd, &s) != 0) || !S_ISREG(s.st_mode) ||
+        (s.st_uid != geteuid()) || ((s.st_mode & (S_IWGRP | S_IWOTH)) != 0))
+    {
+        close(fd);
+        return NULL;
+    }
+    f = fdopen(fd, "rb");
+    if (f == NULL)
+        close(fd);
+    return f;
+}
+
+// Make a new file for writing, readable only by this user.  It fails
+// if anything (a link included) already has the name
+FILE *_imp_privatecreate(char *name)
+{
+    int fd;
+    FILE *f;
+
+    fd = open(name, O_WRONLY | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+    if (fd < 0)
+        return NULL;
+    f = fdopen(fd, "wb");
+    if (f == NULL)
+    {
+        close(fd);
+        unlink(name);
+    }
+    return f;
+}
+
+// A number which changes whenever the running program is rebuilt
+// (from the size, time and inode of its file), or zero if unknown
+int _imp_buildid()
+{
+    struct stat s;
+    unsigned int h;
+
+    if (stat("/proc/self/exe", &s) != 0)
+        return 0;
+    h = 2166136261u;
+    h = (h ^ (unsigned int)s.st_size) * 16777619u;
+    h = (h ^ (unsigned int)s.st_mtime) * 16777619u;
+    h = (h ^ (unsigned int)s.st_ino) * 16777619u;
+    return (int)h;
+}
+#else
+// Windows keeps each user's files apart by itself
+FILE *_imp_privateopen(char *name)
+{
+    return fopen(name, "rb");
+}
+
+FILE *_imp_privatecreate(char *name)
+{
+    return fopen(name, "wbx");
+}
+
+int _imp_buildid()
+{
+    return 0;
+}
+#endif
+
+// The SHA-256 digest of some text held in store, as sha256sum would
+// show it for a file holding that text, so that a program can say
+// exactly what it read (pass1, for each included file)
+
+static const unsigned int sha256k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROR(x, n)       (((x) >> (n)) | ((x) << (32 - (n))))
+
+// Take one 64 byte block into the hash h
+static void sha256block(unsigned int *h, const unsigned char *block)
+{
+    unsigned int w[64], a[8], s0, s1, t1, t2;
+    int i;
+
+    for (i = 0; i < 16; i++)
+        w[i] = ((unsigned int)block[4*i] << 24) | (block[4*i + 1] << 16)
+             | (block[4*i + 2] << 8) | block[4*i + 3];
+    for (i = 16; i < 64; i++)
+    {
+        s0 = ROR(w[i - 15], 7) ^ ROR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        s1 = ROR(w[i - 2], 17) ^ ROR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    memcpy(a, h, sizeof(a));
+    for (i = 0; i < 64; i++)
+    {
+        t1 = a[7] + (ROR(a[4], 6) ^ ROR(a[4], 11) ^ ROR(a[4], 25))
+           + ((a[4] & a[5]) ^ (~a[4] & a[6])) + sha256k[i] + w[i];
+        t2 = (ROR(a[0], 2) ^ ROR(a[0], 13) ^ ROR(a[0], 22))
+           + ((a[0] & a[1]) ^ (a[0] & a[2]) ^ (a[1] & a[2]));
+        memmove(&a[1], &a[0], 7 * sizeof(unsigned int));
+        a[4] += t1;
+        a[0] = t1 + t2;
+    }
+    for (i = 0; i < 8; i++)
+        h[i] += a[i];
+}
+
+// Put the digest of the length bytes at text, as 64 hex digits and
+// a NUL, in digest
+// (the parameters are in reverse order to the IMP routine)
+void _imp_textdigest(unsigned char *text, int length, char *digest)
+{
+    static const unsigned int start[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    unsigned int h[8];
+    unsigned char block[128];
+    unsigned long long bits;
+    int n, i;
+
+    memcpy(h, start, sizeof(h));
+    bits = (unsigned long long)length * 8;
+    while (length >= 64)
+    {
+        sha256block(h, text);
+        text += 64;
+        length -= 64;
+    }
+
+    // the last of the text, a 1 bit, and the length in bits
+    memset(block, 0, sizeof(block));
+    memcpy(block, text, length);
+    block[length] = 0x80;
+    n = (length < 56) ? 64 : 128;
+    for (i = 1; i <= 8; i++)
+    {
+        block[n - i] = bits & 255;
+        bits >>= 8;
+    }
+    sha256block(h, block);
+    if (n == 128)
+        sha256block(h, &block[64]);
+
+    for (i = 0; i < 8; i++)
+        sprintf(&digest[8*i], "%08x", h[i]);
+}
@@ -0,0 +1,73 @@
+// IMP Runtime Environment
+// Profile counters of modules compiled for profiling (imp77 -Fp)
+
+// Each instrumented module has a header in its "improf" section,
+// giving the address and number of its conditional jump counters
+// (see ibjprof.h in pass3).  The linker gathers the headers together
+// between __start_improf and __stop_improf.  When the program stops,
+// the counts are added to the end of the profile file, as
+//    module <count> <module name>
+// followed by one line of "<reached> <fell through>" for each jump.
+// A later compilation with imp77 -Fu adds up the runs in the file.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define PROFMAGIC       0x46525049
+#define PROFNAMESZ      244
+#define PROFFILE        "imp.prof"
+
+struct profheader {
+    int magic;
+    int sites;
+    unsigned int *counters;
+    char name[PROFNAMESZ];
+};
+
+#ifndef MSVC
+// Only present if some module was instrumented
+extern struct profheader __start_improf[] __attribute__((weak));
+extern struct profheader __stop_improf[] __attribute__((weak));
+#else
+// The MS linker has no __start_/__stop_ symbols for a section, and
+// pass3coff never instruments a module, so there are no headers
+#define __start_improf ((struct profheader *)0)
+#define __stop_improf  ((struct profheader *)0)
+#endif
+
+void _imp_writeprofile()
+{
+    struct profheader *p, *first, *last;
+    FILE *f;
+    char *name;
+    int i;
+
+    first = __start_improf;
+    last = __stop_improf;
+    if (first == last)
+        return;
+
+    name = getenv("IMPPROFILE");
+    if ((name == NULL) || (*name == 0))
+        name = PROFFILE;
+
+    f = fopen(name, "a");
+    if (f == NULL)
+    {
+        fprintf(stderr, "Can't write the profile '%s'\n", name);
+        return;
+    }
+
+    for (p = first; p < last; p++)
+    {
+        if (p->magic != PROFMAGIC)
+            continue;
+        fprintf(f, "module %d %.*s\n", p->sites, PROFNAMESZ, p->name);
+        for (i = 0; i < p->sites; i++)
+            fprintf(f, "%u %u\n", p->counters[2*i], p->counters[2*i + 1]);
+        // so that a second call (eg from a %signal) adds nothing more
+        p->magic = 0;
+    }
+
+    fclose(f);
+}
@@ -0,0 +1,242 @@
+// IMP Runtime Environment
+// Serve requests to run the program again, over a Unix socket
+
+// A program which is run over and over (such as the compiler) can
+// instead be left running as a server.  "_imp_serve" listens on the
+// Unix socket it is given, and for each request forks a copy of the
+// program as it stands.  The copy returns from "_imp_serve" with the
+// command line, environment and directory of the request, and the
+// client's standard input, output and error, and carries on as if
+// it had just been started that way.  Each copy starts from the same
+// state, so nothing one request does is seen by the next, but what
+// the program did before it called "_imp_serve" (impdriver analyses
+// the perm) is there for every copy.
+//
+// Only the user running the server may make requests: the socket is
+// made without any access for others, and the user at the other end
+// of each connection is checked as well.
+//
+// A request (see pass3/impclient.c) is one message carrying the
+// client's three standard streams and a header of three integers:
+// the number of arguments, the number of environment variables and
+// the length of the strings which follow.  The strings are the
+// directory, then the arguments, then the variables, each ending in
+// a NUL.  The reply is the exit status of the copy, as an integer.
+
+#ifdef MSVC
+// There are no Unix sockets or fork under Windows, so the program
+// can't be left running as a server
+int _imp_canserve()
+{
+    return 0;
+}
+
+int _imp_serve(char *path)
+{
+    return 0;
+}
+
+#else
+#define _GNU_SOURCE                     // for struct ucred
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#define MAXREQUEST      (1 << 20)       // bytes of strings in a request
+
+// In imprtl-main: take on a new command line and environment
+// (the parameters are in reverse order to the IMP routine)
+extern void _imp_setarguments(char **argv, char **envp);
+
+extern char **environ;
+
+// Read exactly length bytes, giving zero if they can't be
+static int readall(int fd, char *buffer, int length)
+{
+    int n;
+
+    while (length > 0)
+    {
+        n = read(fd, buffer, length);
+        if (n <= 0)
+            return 0;
+        buffer += n;
+        length -= n;
+    }
+    return 1;
+}
+
+// Read a request from the connection, and make this process into
+// the copy of the program which runs it.  Gives zero if it can't
+static int takerequest(int conn)
+{
+    int header[3];
+    int fds[3];
+    char control[CMSG_SPACE(sizeof(fds))];
+    struct iovec iov;
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+    char *strings, *p, **argv, **envp;
+    int i;
+
+    iov.iov_base = header;
+    iov.iov_len = sizeof(header);
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    if (recvmsg(conn, &msg, 0) != sizeof(header))
+        return 0;
+    cmsg = CMSG_FIRSTHDR(&msg);
+    if ((cmsg == NULL) || (cmsg->cmsg_type != SCM_RIGHTS)
+        || (cmsg->cmsg_len != CMSG_LEN(sizeof(fds))))
+        return 0;
+    memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+
+    if ((header[0] < 1) || (header[1] < 0) || (header[2] < 1)
+        || (header[2] > MAXREQUEST))
+        return 0;
+    strings = malloc(header[2]);
+    argv = malloc((header[0] + 1) * sizeof(char *));
+    envp = malloc((header[1] + 1) * sizeof(char *));
+    if ((strings == NULL) || (argv == NULL) || (envp == NULL))
+        return 0;
+    if (!readall(conn, strings, header[2]) || (strings[header[2] - 1] != 0))
+        return 0;
+
+    // the strings end in NULs, so walking past one at a time is safe
+    // as long as the counts agree with the length
+    p = strings;
+    if (chdir(p) != 0)
+        return 0;
+    for (i = 0; i < header[0] + header[1]; i++)
+    {
+        p += strlen(p) + 1;
+        if (p >= strings + header[2])
+            return 0;
+        if (i < header[0])
+            argv[i] = p;
+        else
+            envp[i - header[0]] = p;
+    }
+    argv[header[0]] = NULL;
+    envp[header[1]] = NULL;
+
+    for (i = 0; i < 3; i++)
+    {
+        dup2(fds[i], i);
+        close(fds[i]);
+    }
+    close(conn);
+
+    environ = envp;
+    _imp_setarguments(argv, envp);
+    return 1;
+}
+
+// Whether the other end of the connection is this user
+static int sameuser(int conn)
+{
+    struct ucred cred;
+    socklen_t length = sizeof(cred);
+
+    if (getsockopt(conn, SOL_SOCKET, SO_PEERCRED, &cred, &length) != 0)
+        return 0;
+    return (length == sizeof(cred)) && (cred.uid == geteuid());
+}
+
+// Non-zero if this system can serve requests at all, so that the
+// program need not get ready for them in vain
+int _imp_canserve()
+{
+    return 1;
+}
+
+// Serve requests on the Unix socket at path.  Gives zero if the
+// socket can't be set up; otherwise only returns (with 1) in a copy
+// of the program which is to run a request
+int _imp_serve(char *path)
+{
+    struct sockaddr_un addr;
+    struct stat st;
+    int server, conn, status;
+    mode_t mask;
+    pid_t pid;
+
+    if (strlen(path) >= sizeof(addr.sun_path))
+        return 0;
+    // an old socket of ours is replaced, but nothing else is removed
+    if (lstat(path, &st) == 0)
+    {
+        if (!S_ISSOCK(st.st_mode) || (st.st_uid != geteuid())
+            || (unlink(path) != 0))
+            return 0;
+    }
+    server = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server < 0)
+        return 0;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    mask = umask(077);
+    status = bind(server, (struct sockaddr *)&addr, sizeof(addr));
+    umask(mask);
+    if ((status != 0) || (listen(server, 64) != 0))
+    {
+        close(server);
+        return 0;
+    }
+
+    // the processes which look after each request need not be waited for
+    signal(SIGCHLD, SIG_IGN);
+    fflush(NULL);
+
+    for (;;)
+    {
+        conn = accept(server, NULL, NULL);
+        if (conn < 0)
+            continue;
+        if (!sameuser(conn))
+        {
+            close(conn);
+            continue;
+        }
+
+        if (fork() != 0)
+        {
+            close(conn);
+            continue;
+        }
+
+        // This process waits for the copy which runs the request, so
+        // as to send its exit status back
+        close(server);
+        signal(SIGCHLD, SIG_DFL);
+        pid = fork();
+        if (pid == 0)
+        {
+            if (takerequest(conn))
+                return 1;
+            _exit(255);
+        }
+        status = 255;
+        if ((pid > 0) && (waitpid(pid, &status, 0) == pid))
+        {
+            if (WIFEXITED(status))
+                status = WEXITSTATUS(status);
+            else
+                status = 128 + WTERMSIG(status);
+        }
+        write(conn, &status, sizeof(status));
+        _exit(0);
+    }
+}
+#endif
@@ -0,0 +1,226 @@
+// IMP Runtime Environment
+// A second thread, and a queue of blocks of store between the threads
+
+// A program may run one routine on a second thread while it carries
+// on itself.  The routine is the program's external "_imp_thread",
+// which has its own set of I/O streams (see imprtl-io, which picks
+// the set by the thread slot), so that each thread selects streams
+// without upsetting the other.
+//
+// Blocks of store are passed from one thread to the other through a
+// bounded ring with a single writer and a single reader.  A thread
+// which finds the ring full (or empty) sleeps until the other has
+// taken (or put) a block.  Whoever takes a block frees it.
+//
+// If the second thread stops the program (an abort, or an event with
+// no handler, ends in impexit) it must not close the streams and exit
+// while the first thread is still using them.  It stops just itself,
+// and its exit status is handed to the first thread, which exits with
+// it once it has waited for the second thread to finish.
+
+#ifdef MSVC
+// There is no second thread under Windows yet.  Starting one always
+// fails, so the program carries on sequentially (impdriver then runs
+// pass2 after pass1, with the icode in store), and the rest is never
+// reached with a thread running.
+
+int _imp_threadcount = 0;
+
+int _imp_threadslot()
+{
+    return 0;
+}
+
+int _imp_startthread()
+{
+    return 0;
+}
+
+int _imp_jointhread(int *status)
+{
+    return 0;
+}
+
+void _imp_threadexit(int status)
+{
+}
+
+void _imp_queueopen()
+{
+}
+
+void _imp_queueput(int length, int start)
+{
+}
+
+void _imp_queueclose(int abandon)
+{
+}
+
+int _imp_queueget(int *length)
+{
+    *length = 0;
+    return 0;
+}
+
+#else
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define QUEUESIZE       256     // blocks in the ring (a power of two)
+
+// Only present in a program which runs a second thread
+extern void _imp_thread() __attribute__((weak));
+
+// Non-zero while the second thread may be running
+int _imp_threadcount = 0;
+
+static __thread int threadslot = 0;
+static pthread_t thread;
+
+static struct {
+    int start;
+    int length;
+} ring[QUEUESIZE];
+
+static unsigned int head = 0;   // the next block to be put
+static unsigned int tail = 0;   // the next block to be taken
+static int closed = 0;          // 1 when all is put, 2 if abandoned
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t notfull = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t notempty = PTHREAD_COND_INITIALIZER;
+
+static int stopped = 0;         // non-zero if the second thread stopped
+static int stopstatus = 0;      // the program, and with this status
+
+int _imp_threadslot()
+{
+    return threadslot;
+}
+
+static void *threadstart(void *p)
+{
+    threadslot = 1;
+    _imp_thread();
+    return NULL;
+}
+
+// Start "_imp_thread" on the second thread, giving zero if it can't be
+int _imp_startthread()
+{
+    if ((_imp_thread == NULL) || (_imp_threadcount != 0))
+        return 0;
+
+    _imp_threadcount = 1;
+    stopped = 0;
+    if (pthread_create(&thread, NULL, threadstart, NULL) != 0)
+    {
+        _imp_threadcount = 0;
+        return 0;
+    }
+    return 1;
+}
+
+// Wait for the second thread to finish.  Gives non-zero if it stopped
+// the program, and the status the program should exit with
+int _imp_jointhread(int *status)
+{
+    if (_imp_threadcount == 0)
+        return 0;
+
+    pthread_join(thread, NULL);
+    _imp_threadcount = 0;
+    *status = stopstatus;
+    return stopped;
+}
+
+// The second thread is stopping the program (from impexit), so stop
+// the thread, and leave the rest to the first thread
+void _imp_threadexit(int status)
+{
+    pthread_mutex_lock(&lock);
+    stopped = 1;
+    stopstatus = status;
+    pthread_cond_broadcast(&notfull);
+    pthread_mutex_unlock(&lock);
+    pthread_exit(NULL);
+}
+
+// Empty the queue ready for use
+void _imp_queueopen()
+{
+    pthread_mutex_lock(&lock);
+    head = 0;
+    tail = 0;
+    closed = 0;
+    pthread_mutex_unlock(&lock);
+}
+
+// Put a block on the queue, waiting while the queue is full.  If the
+// second thread has stopped there is no one to take it, so it is freed
+// (the parameters are in reverse order, as IMP passes them)
+void _imp_queueput(int length, int start)
+{
+    pthread_mutex_lock(&lock);
+    while ((head - tail >= QUEUESIZE) && (stopped == 0))
+        pthread_cond_wait(&notfull, &lock);
+
+    if (stopped != 0)
+    {
+        pthread_mutex_unlock(&lock);
+        free((void *)(intptr_t)start);
+        return;
+    }
+
+    ring[head & (QUEUESIZE - 1)].start = start;
+    ring[head & (QUEUESIZE - 1)].length = length;
+    head += 1;
+    pthread_cond_signal(&notempty);
+    pthread_mutex_unlock(&lock);
+}
+
+// Say that nothing more will be put on the queue.  If the queue is
+// abandoned the second thread stops when it next wants a block
+void _imp_queueclose(int abandon)
+{
+    pthread_mutex_lock(&lock);
+    closed = abandon ? 2 : 1;
+    pthread_cond_broadcast(&notempty);
+    pthread_mutex_unlock(&lock);
+}
+
+// Take the next block from the queue, waiting until there is one.
+// Gives zero once the queue is closed and empty
+int _imp_queueget(int *length)
+{
+    int start;
+
+    pthread_mutex_lock(&lock);
+    for (;;)
+    {
+        if ((closed == 2) && (threadslot != 0))
+        {
+            pthread_mutex_unlock(&lock);
+            pthread_exit(NULL);
+        }
+        if (tail != head)
+            break;
+        if (closed != 0)
+        {
+            pthread_mutex_unlock(&lock);
+            *length = 0;
+            return 0;
+        }
+        pthread_cond_wait(&notempty, &lock);
+    }
+
+    start = ring[tail & (QUEUESIZE - 1)].start;
+    *length = ring[tail & (QUEUESIZE - 1)].length;
+    tail += 1;
+    pthread_cond_signal(&notfull);
+    pthread_mutex_unlock(&lock);
+    return start;
+}
+#endif
@@ -0,0 +1,82 @@
+// IMP Runtime Environment
+// Clocks, for timing the phases of a program
+
+// Both give milliseconds from the first reading of that clock, so
+// only the difference between two readings means anything.  The
+// processor time is that of the whole process (all of its threads).
+// The seconds are counted from the first reading before they are
+// scaled, as the monotonic clock's seconds since boot would soon
+// overflow a 32 bit count of milliseconds.
+
+#ifdef MSVC
+#include <windows.h>
+
+// Processor time used so far (user and kernel, in 100ns units from
+// GetProcessTimes)
+int _imp_cputime()
+{
+    static ULONGLONG start = 0;
+    static int started = 0;
+    FILETIME created, exited, kernel, user;
+    ULONGLONG t;
+
+    if (!GetProcessTimes(GetCurrentProcess(), &created, &exited, &kernel, &user))
+        return 0;
+    t = ((ULONGLONG)kernel.dwHighDateTime << 32) + kernel.dwLowDateTime
+      + ((ULONGLONG)user.dwHighDateTime << 32) + user.dwLowDateTime;
+    if (!started)
+    {
+        start = t;
+        started = 1;
+    }
+    return (int)((t - start) / 10000);
+}
+
+// Elapsed (wall clock) time, from the performance counter
+int _imp_realtime()
+{
+    static LARGE_INTEGER start, frequency;
+    static int started = 0;
+    LARGE_INTEGER t;
+
+    if (!QueryPerformanceCounter(&t))
+        return 0;
+    if (!started)
+    {
+        QueryPerformanceFrequency(&frequency);
+        start = t;
+        started = 1;
+    }
+    return (int)((t.QuadPart - start.QuadPart) * 1000 / frequency.QuadPart);
+}
+
+#else
+#include <time.h>
+
+static int milliseconds(clockid_t clock, time_t *start)
+{
+    struct timespec t;
+
+    if (clock_gettime(clock, &t) != 0)
+        return 0;
+    if (*start < 0)
+        *start = t.tv_sec;
+    return (int)((t.tv_sec - *start) * 1000 + t.tv_nsec / 1000000);
+}
+
+// Processor time used so far
+int _imp_cputime()
+{
+    static time_t start = -1;
+
+    return milliseconds(CLOCK_PROCESS_CPUTIME_ID, &start);
+}
+
+// Elapsed (wall clock) time
+int _imp_realtime()
+{
+    static time_t start = -1;
+
+    return milliseconds(CLOCK_MONOTONIC, &start);
+}
+#endif
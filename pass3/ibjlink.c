@@ -0,0 +1,953 @@
+// IMP Compiler for 80386 - pass 3
+// In-store image model shared by the direct image builders
+
+// This reads the intermediate object files produced by the
+// second pass and turns each one into sections, symbols and
+// relocations of an in-store image.  The code generated is
+// exactly that which pass3elf would plant in the object file,
+// and the trap and line tables are laid out the same way, so
+// that the run time library cannot tell the difference.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pass3core.h"
+#include "pass3elf.h"
+#include "ibjlink.h"
+
+#define MAINPROGNAME    "main"
+#define TRAPLIMITNAME   "traplimit"
+#define LINELIMITNAME   "linelimit"
+#define TRAPENTRYSZ     32
+#define LINEENTRYSZ     8
+#define LINEHEADERSZ  256
+
+#define TRAPBASE        "_imptrapbase"
+#define TRAPLIMIT       "_imptraplimit"
+#define LINEBASE        "_implinebase"
+#define LINELIMIT       "_implinelimit"
+
+// The image model itself (each table grows as required)
+struct lsection *lsections = NULL;
+int nlsections = 0;
+static int maxlsections = 0;
+
+struct lsymbol *lsymbols = NULL;
+int nlsymbols = 0;
+static int maxlsymbols = 0;
+
+struct lreloc *lrelocs = NULL;
+int nlrelocs = 0;
+static int maxlrelocs = 0;
+
+#define MAXMODULE 500
+char *lmodules[MAXMODULE];
+int nlmodules = 0;
+
+// Global symbols are found by name through a simple hash table
+#define HASHSIZE 4096
+static int hashtable[HASHSIZE];
+static int hashready = 0;
+
+//////// Database routines
+
+static void *growtable(void *table, int *limit, int itemsize)
+{
+    *limit = (*limit == 0) ? 256 : (*limit * 2);
+    table = realloc(table, (*limit) * itemsize);
+    if (table == NULL)
+    {
+        fprintf(stderr, "Out of memory building the image\n");
+        exit(1);
+    }
+    return table;
+}
+
+static char *copyname(char *name)
+{
+    char *s;
+
+    if (name == NULL)
+        return NULL;
+    s = malloc(strlen(name) + 1);
+    if (s == NULL)
+    {
+        fprintf(stderr, "Out of memory building the image\n");
+        exit(1);
+    }
+    strcpy(s, name);
+    return s;
+}
+
+static unsigned int hashname(char *name)
+{
+    unsigned int h;
+
+    h = 0;
+    while (*name)
+        h = (h * 31) + (unsigned char)*name++;
+    return h & (HASHSIZE - 1);
+}
+
+// remember the name of the module we are about to load
+int newlmodule(char *name)
+{
+    if (nlmodules == MAXMODULE)
+    {
+        fprintf(stderr, "Too many modules\n");
+        fprintf(stderr, "Increase the value of MAXMODULE\n");
+        exit(1);
+    }
+    lmodules[nlmodules] = copyname(name);
+    nlmodules += 1;
+    return (nlmodules - 1);
+}
+
+// return the index of a new (empty) section
+int newlsection(char *name, int kind, int order, int align, int module)
+{
+    struct lsection *sp;
+
+    if (nlsections == maxlsections)
+        lsections = growtable(lsections, &maxlsections, sizeof(struct lsection));
+
+    sp = &lsections[nlsections];
+    sp->name = copyname(name);
+    sp->kind = kind;
+    sp->order = order;
+    sp->align = (align < 1) ? 1 : align;
+    sp->size = 0;
+    sp->limit = 0;
+    sp->data = NULL;
+    sp->addr = 0;
+    sp->module = module;
+
+    nlsections += 1;
+    return (nlsections - 1);
+}
+
+// append bytes to a section (a NULL data pointer appends zeroes)
+void putlbytes(int section, unsigned char *data, int count)
+{
+    struct lsection *sp;
+    int newlimit;
+
+    sp = &lsections[section];
+    if ((sp->size + count) > sp->limit)
+    {
+        newlimit = (sp->limit == 0) ? 256 : sp->limit;
+        while (newlimit < (sp->size + count))
+            newlimit = newlimit * 2;
+        sp->data = realloc(sp->data, newlimit);
+        if (sp->data == NULL)
+        {
+            fprintf(stderr, "Out of memory building the image\n");
+            exit(1);
+        }
+        sp->limit = newlimit;
+    }
+    if (data == NULL)
+        memset(&sp->data[sp->size], 0, count);
+    else
+        memcpy(&sp->data[sp->size], data, count);
+    sp->size += count;
+}
+
+void putlword(int section, unsigned int w)
+{
+    unsigned char b[4];
+
+    b[0] = w & 255;
+    b[1] = (w >> 8) & 255;
+    b[2] = (w >> 16) & 255;
+    b[3] = (w >> 24) & 255;
+    putlbytes(section, b, 4);
+}
+
+void putlzero(int section, int count)
+{
+    putlbytes(section, NULL, count);
+}
+
+static int newlsymbol(char *name, int section, unsigned int value, int bind, int type)
+{
+    struct lsymbol *sp;
+
+    if (nlsymbols == maxlsymbols)
+        lsymbols = growtable(lsymbols, &maxlsymbols, sizeof(struct lsymbol));
+
+    sp = &lsymbols[nlsymbols];
+    sp->name = copyname(name);
+    sp->section = section;
+    sp->value = value;
+    sp->bind = bind;
+    sp->type = type;
+    sp->align = 1;
+    sp->next = -1;
+    sp->got = 0;
+    sp->used = 0;
+
+    nlsymbols += 1;
+    return (nlsymbols - 1);
+}
+
+// local symbols never take part in name resolution
+int newlocalsymbol(char *name, int section, unsigned int value, int type)
+{
+    return newlsymbol(name, section, value, LS_LOCAL, type);
+}
+
+// return the index of the named global symbol, creating an
+// undefined reference to it if it hasn't been seen before
+int findglobalsymbol(char *name)
+{
+    int i, h;
+
+    if (hashready == 0)
+    {
+        for (i = 0; i < HASHSIZE; i++)
+            hashtable[i] = -1;
+        hashready = 1;
+    }
+
+    h = hashname(name);
+    for (i = hashtable[h]; i >= 0; i = lsymbols[i].next)
+    {
+        if (strcmp(lsymbols[i].name, name) == 0)
+            return i;
+    }
+
+    i = newlsymbol(name, LS_UNDEF, 0, LS_GLOBAL, STT_NOTYPE);
+    lsymbols[i].next = hashtable[h];
+    hashtable[h] = i;
+    return i;
+}
+
+// define a global symbol, taking care that a weak definition
+// never replaces a strong one
+int defineglobalsymbol(char *name, int section, unsigned int value, int bind, int type)
+{
+    int i;
+    struct lsymbol *sp;
+
+    i = findglobalsymbol(name);
+    sp = &lsymbols[i];
+    // a common block never overrides a real definition
+    if ((section == LS_COMMON) && (sp->section != LS_UNDEF) && (sp->section != LS_COMMON))
+        return i;
+    if ((sp->section != LS_UNDEF) && (sp->section != LS_COMMON))
+    {
+        // already defined, so who wins?
+        if (bind == LS_WEAK)
+            return i;
+        if (sp->bind != LS_WEAK)
+        {
+            fprintf(stderr, "Symbol '%s' is defined more than once\n", name);
+            exit(1);
+        }
+    }
+    if ((section == LS_COMMON) && (sp->section == LS_COMMON))
+    {
+        // merge common blocks by taking the biggest
+        if (value > sp->value) sp->value = value;
+        return i;
+    }
+    sp->section = section;
+    sp->value = value;
+    sp->bind = bind;
+    sp->type = type;
+    return i;
+}
+
+// note a word that has to be patched once the image is laid out
+void newlreloc(int section, int offset, int type, int symbol)
+{
+    struct lreloc *rp;
+
+    if (nlrelocs == maxlrelocs)
+        lrelocs = growtable(lrelocs, &maxlrelocs, sizeof(struct lreloc));
+
+    rp = &lrelocs[nlrelocs];
+    rp->section = section;
+    rp->offset = offset;
+    rp->type = type;
+    rp->symbol = symbol;
+    lsymbols[symbol].used = 1;
+
+    nlrelocs += 1;
+}
+
+//////// Loading an .ibj module
+
+// Each .ibj record is held in store so that we can make
+// as many passes over the module as we like
+struct irecord {
+    int type;
+    int length;
+    unsigned char *data;
+};
+
+static struct irecord *irecords = NULL;
+static int nirecords = 0;
+static int maxirecords = 0;
+
+static void readibjrecords(char *inname)
+{
+    FILE *input;
+    int type, length;
+    unsigned char buffer[256];
+    struct irecord *rp;
+
+    input = fopen(inname, "r");
+    if (input == NULL)
+    {
+        perror("Can't open input file");
+        fprintf(stderr, "Can't open input file '%s'\n",inname);
+        exit(1);
+    }
+
+    nirecords = 0;
+    for(;;)
+    {
+        memset(buffer, 0, sizeof(buffer));
+        readifrecord(input, &type, &length, buffer);
+        if (type < 0)
+            break;
+
+        if (nirecords == maxirecords)
+            irecords = growtable(irecords, &maxirecords, sizeof(struct irecord));
+        rp = &irecords[nirecords];
+        rp->type = type;
+        rp->length = length;
+        // keep one extra byte so names can be zero terminated
+        rp->data = malloc(length + 1);
+        if (rp->data == NULL)
+        {
+            fprintf(stderr, "Out of memory reading '%s'\n", inname);
+            exit(1);
+        }
+        memcpy(rp->data, buffer, length);
+        rp->data[length] = 0;
+        nirecords += 1;
+    }
+    fclose(input);
+}
+
+static void freeibjrecords()
+{
+    int i;
+
+    for (i = 0; i < nirecords; i++)
+        free(irecords[i].data);
+    nirecords = 0;
+}
+
+// The entry to each routine is matched with its stack fixup
+// record, and the pair provides the trap table entry
+struct lroutine {
+    int id;
+    int frame;
+    int events;
+    int trap;
+    int evfrom;
+    int start;
+    int end;
+    char *name;
+};
+
+#define MAXROUTINE 2000
+static struct lroutine routines[MAXROUTINE];
+static int nroutines;
+
+// label addresses for this module (a label ID is a 16 bit number)
+static int labeladdress[65536];
+
+// external names (%spec'ed by pass 2) for this module
+#define MAXSPECS 1000
+static char *specnames[MAXSPECS];
+static int nspecnames;
+
+// line number information for this module
+struct llineno {
+    int line;
+    int offset;
+};
+static struct llineno *llines = NULL;
+static int nllines = 0;
+static int maxllines = 0;
+
+static void newllineno(int line, int addr)
+{
+    // have the line numbers advanced, but the code didn't?
+    if ((nllines > 0) && (llines[nllines - 1].offset == addr))
+    {
+        llines[nllines - 1].line = line;
+        return;
+    }
+    if (nllines == maxllines)
+        llines = growtable(llines, &maxllines, sizeof(struct llineno));
+    llines[nllines].line = line;
+    llines[nllines].offset = addr;
+    nllines += 1;
+}
+
+static int findroutine(int id)
+{
+    int i;
+
+    for (i = 0; i < nroutines; i++)
+        if (routines[i].id == id)
+            return i;
+    return -1;
+}
+
+static int codeword(unsigned char *b)
+{
+    return b[0] | (b[1] << 8);
+}
+
+// Pass2 asks for stricter alignment of a section as it needs it
+static void raisealign(int section, int align)
+{
+    if (align > lsections[section].align)
+        lsections[section].align = align;
+}
+
+// little-endian 16 bit value, ready to plant
+static unsigned char *twobytes(int w)
+{
+    static unsigned char b[2];
+
+    b[0] = w & 255;
+    b[1] = (w >> 8) & 255;
+    return b;
+}
+
+static int codelong(unsigned char *b)
+{
+    return b[0] | (b[1] << 8) | (b[2] << 16) | (b[3] << 24);
+}
+
+// write the IMP string module header of a line table
+static void putllineheader(int section, char *modulename, int count)
+{
+    int length, maxlength;
+    unsigned char header[LINEHEADERSZ];
+
+    memset(header, 0, LINEHEADERSZ);
+    // leave room for the length byte and the line count
+    maxlength = LINEHEADERSZ - 4 - 1;
+    length = strlen(modulename);
+    if (length > maxlength) length = maxlength;
+    header[0] = length;
+    memcpy(&header[1], modulename, length);
+    header[LINEHEADERSZ - 4] = count & 255;
+    header[LINEHEADERSZ - 3] = (count >> 8) & 255;
+    header[LINEHEADERSZ - 2] = (count >> 16) & 255;
+    header[LINEHEADERSZ - 1] = (count >> 24) & 255;
+    putlbytes(section, header, LINEHEADERSZ);
+}
+
+void loadibjmodule(char *inname)
+{
+    int module, i, j, type, length, cad, id, value, offset, count;
+    int mainprogflag, traplimitflag, linelimitflag;
+    int code, constant, data, bss, swtab, trap, line, limit;
+    int codesym, constsym, datasym, bsssym, swtabsym;
+    unsigned char *b;
+    unsigned char op[2];
+    char modulename[256];
+    struct lroutine *rp;
+
+    module = newlmodule(inname);
+    readibjrecords(inname);
+
+    // First pass - find the routines, the labels and the special
+    // module flags, and work out the code address of everything.
+    // Just as in pass3elf, all jumps are planted in their long form.
+    mainprogflag = 0;
+    traplimitflag = 0;
+    linelimitflag = 0;
+    nroutines = 0;
+    nspecnames = 0;
+    strcpy(modulename, inname);
+    memset(labeladdress, 0, sizeof(labeladdress));
+
+    cad = 0;
+    for (i = 0; i < nirecords; i++)
+    {
+        type = irecords[i].type;
+        length = irecords[i].length;
+        b = irecords[i].data;
+        switch(type)
+        {
+        case IF_OBJ:
+            cad += length;
+            break;
+
+        case IF_DATA:
+        case IF_CONST:
+        case IF_DISPLAY:
+        case IF_REFEXT:
+        case IF_BSS:
+        case IF_SWT:
+        case IF_ABSEXT:
+        case IF_REFLABEL:
+            cad += WORDSIZE;
+            break;
+
+        case IF_JUMP:
+        case IF_CALL:
+            cad += 5;
+            break;
+
+        case IF_JCOND:
+            cad += 6;
+            break;
+
+        case IF_FIXUP:
+            if (nroutines == MAXROUTINE)
+            {
+                fprintf(stderr, "Too many subroutines\n");
+                fprintf(stderr, "Increase the value of MAXROUTINE\n");
+                exit(1);
+            }
+            rp = &routines[nroutines];
+            rp->id = codeword(b);
+            rp->frame = 0;
+            rp->events = 0;
+            rp->trap = 0;
+            rp->evfrom = 0;
+            rp->name = copyname((char *)&b[3]);
+            nroutines += 1;
+            cad += 4;
+            break;
+
+        case IF_SETFIX:
+            j = findroutine(codeword(b));
+            if (j < 0)
+            {
+                fprintf(stderr, "Stack fixup for undefined ID?\n");
+                break;
+            }
+            // compiler passes the amount as a 16 bit negative number,
+            // but we plant an ENTER instruction, so make it positive
+            routines[j].frame = (- codeword(&b[2])) & 0xffff;
+            routines[j].events = codeword(&b[4]);
+            routines[j].trap = codeword(&b[6]);
+            routines[j].evfrom = codeword(&b[8]);
+            break;
+
+        case IF_LABEL:
+            // NB Pass 2 redefines labels sometimes, and the last definition wins
+            labeladdress[codeword(b)] = cad;
+            break;
+
+        case IF_REQEXT:
+            if (nspecnames == MAXSPECS - 1)
+            {
+                fprintf(stderr, "Too many %%spec's\n");
+                fprintf(stderr, "Increase the value of MAXSPECS\n");
+                exit(1);
+            }
+            // pass 2 spec's use 1-based IDs
+            nspecnames += 1;
+            specnames[nspecnames] = copyname((char *)b);
+            break;
+
+        case IF_SOURCE:
+            strcpy(modulename, (char *)b);
+            break;
+
+        case IF_DEFEXTCODE:
+            if (strcmp((char *)b, MAINPROGNAME) == 0)
+                mainprogflag = 1;
+            break;
+
+        case IF_DEFEXTDATA:
+            if (strcmp((char *)b, TRAPLIMITNAME) == 0)
+                traplimitflag = 1;
+            if (strcmp((char *)b, LINELIMITNAME) == 0)
+                linelimitflag = 1;
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    // Now create the sections for this module, each with a local
+    // symbol to act as the relocation base
+    code = newlsection(".text", LS_TEXT, 0, 4, module);
+    constant = newlsection(".rodata", LS_RODATA, 0, 4, module);
+    data = newlsection(".data", LS_DATA, 0, 4, module);
+    bss = newlsection(".bss", LS_BSS, 0, 4, module);
+    swtab = newlsection(".switch", LS_RODATA, 0, 4, module);
+    if (mainprogflag != 0)
+    {
+        trap = newlsection(".imp.trap.B", LS_TRAP, LS_ORDERB, TRAPENTRYSZ, module);
+        line = newlsection(".imp.line.B", LS_LINE, LS_ORDERB, LINEHEADERSZ, module);
+    }
+    else
+    {
+        trap = newlsection(".imp.trap.D", LS_TRAP, LS_ORDERD, TRAPENTRYSZ, module);
+        line = newlsection(".imp.line.D", LS_LINE, LS_ORDERD, LINEHEADERSZ, module);
+    }
+
+    codesym = newlocalsymbol(NULL, code, 0, STT_SECTION);
+    constsym = newlocalsymbol(NULL, constant, 0, STT_SECTION);
+    datasym = newlocalsymbol(NULL, data, 0, STT_SECTION);
+    bsssym = newlocalsymbol(NULL, bss, 0, STT_SECTION);
+    swtabsym = newlocalsymbol(NULL, swtab, 0, STT_SECTION);
+
+    // Second pass - plant the code and data
+    nllines = 0;
+    cad = 0;
+    for (i = 0; i < nirecords; i++)
+    {
+        type = irecords[i].type;
+        length = irecords[i].length;
+        b = irecords[i].data;
+        switch(type)
+        {
+        case IF_OBJ:
+            // plain object code
+            putlbytes(code, b, length);
+            cad += length;
+            break;
+
+        case IF_DATA:
+            // data section offset word
+            putlbytes(code, b, WORDSIZE);
+            newlreloc(code, cad, R_386_32, datasym);
+            cad += WORDSIZE;
+            break;
+
+        case IF_CONST:
+            // const section offset word
+            putlbytes(code, b, WORDSIZE);
+            newlreloc(code, cad, R_386_32, constsym);
+            cad += WORDSIZE;
+            break;
+
+        case IF_DISPLAY:
+            // display offset word (planted as it stands)
+            putlbytes(code, b, WORDSIZE);
+            cad += WORDSIZE;
+            break;
+
+        case IF_JUMP:
+            // unconditional jump to label
+            value = labeladdress[codeword(b)];
+            putlbytes(code, (unsigned char *)"\xE9", 1);
+            putlword(code, value - (cad + 5));
+            cad += 5;
+            break;
+
+        case IF_JCOND:
+            // cond jump to label JE, JNE, JLE, JL, JGE, JG
+            value = labeladdress[codeword(&b[1])];
+            op[0] = 0x0F;
+            op[1] = jcondop[b[0]] + 0x10;
+            putlbytes(code, op, 2);
+            putlword(code, value - (cad + 6));
+            cad += 6;
+            break;
+
+        case IF_CALL:
+            // call a label
+            value = labeladdress[codeword(b)];
+            putlbytes(code, (unsigned char *)"\xE8", 1);
+            putlword(code, value - (cad + 5));
+            cad += 5;
+            break;
+
+        case IF_LABEL:
+            break;
+
+        case IF_FIXUP:
+            // define location for stack fixup instruction
+            j = findroutine(codeword(b));
+            value = (j >= 0) ? routines[j].frame : 0;
+            if (length == 2)
+            {
+                // classic 8086 fixup - SUB SP,nnnn
+                putlbytes(code, (unsigned char *)"\x81\xEC", 2);
+                putlbytes(code, twobytes(value), 2);
+            }
+            else
+            {
+                // 80286 fixup - ENTER nnnn,level
+                putlbytes(code, (unsigned char *)"\xC8", 1);
+                putlbytes(code, twobytes(value), 2);
+                putlbytes(code, &b[2], 1);
+            }
+            if (j >= 0)
+                routines[j].start = cad;
+            cad += 4;
+            break;
+
+        case IF_SETFIX:
+            j = findroutine(codeword(b));
+            if (j >= 0)
+                routines[j].end = cad;
+            break;
+
+        case IF_REQEXT:
+            break;
+
+        case IF_REFLABEL:
+            // label's relative address with optional offset
+            value = labeladdress[codeword(b)];
+            offset = codeword(&b[2]);
+            putlword(code, value - (cad + WORDSIZE + offset));
+            cad += WORDSIZE;
+            break;
+
+        case IF_REFEXT:
+            // external name relative offset code word
+            id = codeword(b);
+            putlword(code, -4);
+            newlreloc(code, cad, R_386_PC32, findglobalsymbol(specnames[id]));
+            cad += WORDSIZE;
+            break;
+
+        case IF_BSS:
+            // BSS section offset word
+            putlbytes(code, b, WORDSIZE);
+            newlreloc(code, cad, R_386_32, bsssym);
+            cad += WORDSIZE;
+            break;
+
+        case IF_COTWORD:
+            // Constant table word (with an optional alignment)
+            putlbytes(constant, b, 2);
+            if (length == 4)
+                raisealign(constant, codeword(&b[2]));
+            break;
+
+        case IF_DATWORD:
+            // Data section word (repeated, with an optional alignment)
+            count = (length >= 4) ? codeword(&b[2]) : 1;
+            for (j = 0; j < count; j++)
+                putlbytes(data, b, 2);
+            if (length == 6)
+                raisealign(data, codeword(&b[4]));
+            break;
+
+        case IF_BSSBLOCK:
+            // reserve a block of zeroed data (which needs no buffer)
+            lsections[bss].size += b[0] | (b[1] << 8) | (b[2] << 16) | (b[3] << 24);
+            if (length == 8)
+                raisealign(bss, b[4] | (b[5] << 8) | (b[6] << 16) | (b[7] << 24));
+            break;
+
+        case IF_SWTWORD:
+            // switch table entry - actually a label ID
+            value = labeladdress[codeword(b)];
+            newlreloc(swtab, lsections[swtab].size, R_386_32, codesym);
+            putlword(swtab, value);
+            break;
+
+        case IF_DEFEXTCODE:
+            // define a code label that is external
+            defineglobalsymbol((char *)b, code, cad, LS_GLOBAL, STT_FUNC);
+            break;
+
+        case IF_DEFEXTDATA:
+            // define a data label that is external
+            // (NB using the current code address, just as pass3elf does)
+            defineglobalsymbol((char *)b, data, cad, LS_GLOBAL, STT_OBJECT);
+            break;
+
+        case IF_SWT:
+            // SWITCH table section offset code word
+            putlbytes(code, b, WORDSIZE);
+            newlreloc(code, cad, R_386_32, swtabsym);
+            cad += WORDSIZE;
+            break;
+
+        case IF_LINE:
+            // line number info for the debugger
+            newllineno(codeword(b), cad);
+            break;
+
+        case IF_ABSEXT:
+            // external name absolute offset code word (data external)
+            id = codeword(b);
+            putlword(code, codeword(&b[2]));
+            newlreloc(code, cad, R_386_32, findglobalsymbol(specnames[id]));
+            cad += WORDSIZE;
+            break;
+
+        case IF_VERSION:
+        case IF_SOURCE:
+        case IF_COMMENT:
+            break;
+
+        default:
+            fprintf(stderr, "Unexpected tag %d in '%s' - not handled\n", type, inname);
+            break;
+        }
+    }
+
+    // plant the trap table entries
+    // <StartAddr32><EndAddr32><TrapAddr32><FromAddr32><EventMask16><Name[14]>
+    for (i = 0; i < nroutines; i++)
+    {
+        rp = &routines[i];
+        offset = lsections[trap].size;
+        putlword(trap, rp->start);
+        putlword(trap, rp->end);
+        putlword(trap, labeladdress[rp->trap]);
+        putlword(trap, labeladdress[rp->evfrom]);
+        for (j = 0; j < 4; j++)
+            newlreloc(trap, offset + (j * 4), R_386_32, codesym);
+        putlbytes(trap, twobytes(rp->events), 2);
+        putlzero(trap, 14);
+        strncpy((char *)&lsections[trap].data[offset + 18], rp->name, 14);
+        free(rp->name);
+    }
+
+    // plant the line table for this module
+    putllineheader(line, modulename, nllines);
+    for (i = 0; i < nllines; i++)
+    {
+        putlword(line, llines[i].line);
+        newlreloc(line, lsections[line].size, R_386_32, codesym);
+        putlword(line, llines[i].offset);
+    }
+
+    // define the special symbols exactly as pass3elf would
+    if (mainprogflag != 0)
+    {
+        if (nroutines != 0)
+            defineglobalsymbol(TRAPBASE, trap, 0, LS_GLOBAL, STT_OBJECT);
+        if (nllines != 0)
+            defineglobalsymbol(LINEBASE, line, 0, LS_GLOBAL, STT_OBJECT);
+    }
+    if (traplimitflag != 0)
+    {
+        limit = newlsection(".imp.trap.F", LS_TRAP, LS_ORDERF, TRAPENTRYSZ, module);
+        putlzero(limit, TRAPENTRYSZ);
+        defineglobalsymbol(TRAPLIMIT, limit, 0, LS_GLOBAL, STT_OBJECT);
+    }
+    if (linelimitflag != 0)
+    {
+        limit = newlsection(".imp.line.F", LS_LINE, LS_ORDERF, LINEHEADERSZ, module);
+        putllineheader(limit, modulename, 0);
+        defineglobalsymbol(LINELIMIT, limit, 0, LS_GLOBAL, STT_OBJECT);
+    }
+
+    for (i = 1; i <= nspecnames; i++)
+        free(specnames[i]);
+    freeibjrecords();
+}
+
+//////// Layout
+
+static int comparesections(const void *a, const void *b)
+{
+    struct lsection *sa, *sb;
+
+    sa = &lsections[*(int *)a];
+    sb = &lsections[*(int *)b];
+    if (sa->kind != sb->kind)
+        return sa->kind - sb->kind;
+    if (sa->order != sb->order)
+        return sa->order - sb->order;
+    // otherwise keep the order they were loaded
+    return *(int *)a - *(int *)b;
+}
+
+// the section numbers sorted into their load order
+// (by kind, then order within the kind, then as loaded)
+int *lsortsections()
+{
+    int i;
+    int *order;
+
+    order = malloc(nlsections * sizeof(int));
+    if (order == NULL)
+    {
+        fprintf(stderr, "Out of memory building the image\n");
+        exit(1);
+    }
+    for (i = 0; i < nlsections; i++)
+        order[i] = i;
+    qsort(order, nlsections, sizeof(int), comparesections);
+    return order;
+}
+
+//////// Relocation support
+
+// the final address of a symbol (once the image has been laid out)
+unsigned int lsymboladdress(int symbol)
+{
+    struct lsymbol *sp;
+
+    sp = &lsymbols[symbol];
+    if (sp->section >= 0)
+        return lsections[sp->section].addr + sp->value;
+    if (sp->section == LS_ABS)
+        return sp->value;
+    // undefined weak references resolve to zero
+    return 0;
+}
+
+// patch the word for a simple (absolute or PC relative) relocation
+// returns zero if the relocation type is not one of these
+int lapplyreloc(struct lreloc *r, unsigned int symbolvalue)
+{
+    unsigned char *p;
+    unsigned int place, value;
+
+    p = &lsections[r->section].data[r->offset];
+    place = lsections[r->section].addr + r->offset;
+    // the addend is the word already planted
+    value = codelong(p);
+    switch(r->type)
+    {
+    case R_386_NONE:
+        return 1;
+
+    case R_386_32:
+        value = value + symbolvalue;
+        break;
+
+    case R_386_PC32:
+    case R_386_PLT32:
+        // a static image has no PLT, so calls go direct
+        value = value + symbolvalue - place;
+        break;
+
+    default:
+        return 0;
+    }
+    p[0] = value & 255;
+    p[1] = (value >> 8) & 255;
+    p[2] = (value >> 16) & 255;
+    p[3] = (value >> 24) & 255;
+    return 1;
+}
+
+// count (and optionally report) any symbols that are referenced
+// but were never defined.  Undefined weak symbols are allowed.
+int lundefined(int report)
+{
+    int i, n;
+    struct lsymbol *sp;
+
+    n = 0;
+    for (i = 0; i < nlsymbols; i++)
+    {
+        sp = &lsymbols[i];
+        if ((sp->section == LS_UNDEF) && (sp->bind == LS_GLOBAL) && (sp->used != 0))
+        {
+            if (report != 0)
+                fprintf(stderr, "Undefined symbol '%s'\n", sp->name);
+            n += 1;
+        }
+    }
+    return n;
+}
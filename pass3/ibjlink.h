@@ -0,0 +1,123 @@
+// IMP Compiler for 80386 - pass 3
+// In-store image model shared by the direct image builders
+// (pass3exe writes an executable, pass3run loads and runs it)
+
+// Each .ibj module (and any pre-linked runtime image) is reduced
+// to a list of sections, symbols and relocations.  The image builder
+// then places the sections, resolves the symbols and patches the
+// relocations itself, without the help of an external linker.
+
+// Kinds of section, listed in the order they are placed in the image
+#define LS_TEXT         0 // executable code
+#define LS_RODATA       1 // read-only data (constants, switch tables)
+#define LS_TRAP         2 // IMP trap tables      (.imp.trap.B/D/F)
+#define LS_LINE         3 // IMP line tables      (.imp.line.B/D/F)
+#define LS_DATA         4 // writable data
+#define LS_PREINIT      5 // .preinit_array
+#define LS_INIT         6 // .init_array
+#define LS_FINI         7 // .fini_array
+#define LS_TDATA        8 // initialised thread local data
+#define LS_TBSS         9 // zeroed thread local data
+#define LS_BSS         10 // zeroed data
+#define LS_KINDS       11
+
+// Order of the trap/line tables inside their group
+// (as used by the .imp.trap.X and .imp.line.X section names)
+#define LS_ORDERB       0
+#define LS_ORDERD       1
+#define LS_ORDERF       2
+
+// Special section numbers for a symbol
+#define LS_UNDEF       -1 // not (yet) defined
+#define LS_ABS         -2 // absolute value
+#define LS_COMMON      -3 // common block (value is the size)
+
+// Symbol binding
+#define LS_LOCAL        0
+#define LS_GLOBAL       1
+#define LS_WEAK         2
+
+struct lsection {
+    // name of the section (for classification and diagnostics)
+    char *name;
+    // one of the LS_xxx kinds
+    int kind;
+    // position within the kind (only used for trap/line tables)
+    int order;
+    // required alignment (a power of 2)
+    int align;
+    // size in bytes
+    int size;
+    // allocated size of the data buffer
+    int limit;
+    // section contents (NULL for zeroed sections)
+    unsigned char *data;
+    // final address once placed in the image
+    unsigned int addr;
+    // the module this section came from
+    int module;
+};
+
+struct lsymbol {
+    char *name;
+    // section index, or one of LS_UNDEF, LS_ABS, LS_COMMON
+    int section;
+    // offset in the section (or absolute value)
+    unsigned int value;
+    // LS_LOCAL, LS_GLOBAL or LS_WEAK
+    int bind;
+    // ELF symbol type (STT_xxx)
+    int type;
+    // (common) alignment
+    int align;
+    // next global symbol on this hash chain
+    int next;
+    // GOT slot index (+1), or zero if none allocated
+    int got;
+    // non-zero once a relocation refers to this symbol
+    int used;
+};
+
+struct lreloc {
+    // section containing the word to patch
+    int section;
+    // offset of the word in that section
+    int offset;
+    // relocation type (R_386_xxx)
+    int type;
+    // symbol the word refers to
+    int symbol;
+};
+
+extern struct lsection *lsections;
+extern int nlsections;
+extern struct lsymbol *lsymbols;
+extern int nlsymbols;
+extern struct lreloc *lrelocs;
+extern int nlrelocs;
+
+// the names of the modules loaded so far
+extern char *lmodules[];
+extern int nlmodules;
+
+// Model building routines
+int newlmodule(char *name);
+int newlsection(char *name, int kind, int order, int align, int module);
+void putlbytes(int section, unsigned char *data, int count);
+void putlword(int section, unsigned int w);
+void putlzero(int section, int count);
+int newlocalsymbol(char *name, int section, unsigned int value, int type);
+int findglobalsymbol(char *name);   // creates an undefined reference if needed
+int defineglobalsymbol(char *name, int section, unsigned int value, int bind, int type);
+void newlreloc(int section, int offset, int type, int symbol);
+
+// Load one .ibj file into the image model
+void loadibjmodule(char *inname);
+
+// Image layout
+int *lsortsections();
+
+// Relocation support
+unsigned int lsymboladdress(int symbol);
+int lapplyreloc(struct lreloc *r, unsigned int symbolvalue);
+int lundefined(int report);
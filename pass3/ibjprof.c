@@ -0,0 +1,532 @@
+// IMP Compiler for 80386 - pass 3
+// Profile guided block layout
+
+// This works on the intermediate records themselves, before they are
+// made into an object file.  All the records of a module are read in,
+// then either
+//  (a) each conditional jump gets a counter planted before it (how
+//      often the jump is reached) and after it (how often it falls
+//      through), or
+//  (b) using the counts from an earlier run, each conditional jump
+//      that is mostly taken has the code it falls into moved out of
+//      line, so that the taken path becomes the fall through path.
+// The new records are put in store, for pass3 to read back as usual.
+//
+// For (b) the code moved is the run of records from just after the
+// jump up to (and including) an unconditional jump, provided the
+// label the conditional jump goes to is defined straight after that.
+// This is the shape pass2 gives to "%if ... %then ... %else ...".
+// The run goes to the end of the routine (just before its IF_SETFIX,
+// so it stays inside the routine for the trap tables), the jump is
+// inverted, and it now goes to a new label in front of the moved run.
+// Nothing is moved which would change the order of anything other
+// than the code (constants, data, switch tables, external names).
+// Nor is anything moved in a routine with an event handler, as the
+// trap tables take the code between its trap entry and the end of
+// the handler as the handler itself, and moved code could land there.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pass3core.h"
+#include "ibjprof.h"
+
+// the largest label id an intermediate record can hold
+#define MAXLABELID      0xFFFF
+
+// how often a jump must have been reached to be worth moving code for
+#define PROFMINCOUNT    2
+
+struct precord {
+    int type;
+    int length;
+    unsigned char *data;
+};
+
+static struct precord *precords = NULL;
+static int nprecords = 0;
+static int maxprecords = 0;
+
+// the module name, as given by IF_SOURCE
+static char modname[256];
+
+// counts for each conditional jump, from the profile
+static double *profexec = NULL;
+static double *proffall = NULL;
+
+int profsites = 0;
+int profcounters = 0;
+
+static int codeword(unsigned char *b)
+{
+    return b[0] | (b[1] << 8);
+}
+
+static int codelong(unsigned char *b)
+{
+    return b[0] | (b[1] << 8) | (b[2] << 16) | (b[3] << 24);
+}
+
+//////// Reading and writing the records
+
+static void readrecords(char *inname)
+{
+    FILE *input;
+    int type, length;
+    unsigned char buffer[256];
+    struct precord *rp;
+
+    input = NULL;
+    if (inname == NULL)
+        rewindifstore();
+    else
+    {
+        input = fopen(inname, "r");
+        if (input == NULL)
+        {
+            perror("Can't open input file");
+            fprintf(stderr, "Can't open input file '%s'\n",inname);
+            exit(1);
+        }
+    }
+
+    modname[0] = 0;
+    nprecords = 0;
+    for (;;)
+    {
+        memset(buffer, 0, sizeof(buffer));
+        readifrecord(input, &type, &length, buffer);
+        if (type < 0)
+            break;
+
+        if (nprecords == maxprecords)
+        {
+            maxprecords = (maxprecords == 0) ? 4096 : 2*maxprecords;
+            precords = realloc(precords, maxprecords * sizeof(struct precord));
+            if (precords == NULL)
+            {
+                fprintf(stderr, "Out of memory for the intermediate records\n");
+                exit(1);
+            }
+        }
+        rp = &precords[nprecords++];
+        rp->type = type;
+        rp->length = length;
+        rp->data = malloc(length + 1);
+        if (rp->data == NULL)
+        {
+            fprintf(stderr, "Out of memory for the intermediate records\n");
+            exit(1);
+        }
+        memcpy(rp->data, buffer, length + 1);
+
+        if (type == IF_SOURCE)
+            strcpy(modname, (char *)buffer);
+    }
+
+    if (input != NULL)
+        fclose(input);
+}
+
+static void putword(int type, int w)
+{
+    unsigned char b[2];
+
+    b[0] = w & 255;
+    b[1] = (w >> 8) & 255;
+    putifrecord(type, 2, b);
+}
+
+static void putlong(int type, int w)
+{
+    unsigned char b[4];
+
+    b[0] = w & 255;
+    b[1] = (w >> 8) & 255;
+    b[2] = (w >> 16) & 255;
+    b[3] = (w >> 24) & 255;
+    putifrecord(type, 4, b);
+}
+
+static void putrecord(int i)
+{
+    putifrecord(precords[i].type, precords[i].length, precords[i].data);
+}
+
+//////// Instrumenting
+
+// PUSHFD; INC DWORD [counter]; POPFD
+// (the flags must survive, as the jump after may still need them)
+static void putcounter(int offset)
+{
+    putifrecord(IF_OBJ, 3, (unsigned char *)"\x9C\xFF\x05");
+    putlong(IF_BSS, offset);
+    putifrecord(IF_OBJ, 1, (unsigned char *)"\x9D");
+}
+
+static void instrument()
+{
+    int i, bss, site;
+
+    // the counters go after the module's own .bss
+    bss = 0;
+    profsites = 0;
+    for (i = 0; i < nprecords; i++)
+    {
+        if (precords[i].type == IF_BSSBLOCK)
+            bss += codelong(precords[i].data);
+        if (precords[i].type == IF_JCOND)
+            profsites += 1;
+    }
+    profcounters = (bss + 3) & ~3;
+
+    site = 0;
+    for (i = 0; i < nprecords; i++)
+    {
+        if (precords[i].type == IF_JCOND)
+        {
+            putcounter(profcounters + 8*site);
+            putrecord(i);
+            putcounter(profcounters + 8*site + 4);
+            site += 1;
+        }
+        else
+            putrecord(i);
+    }
+
+    if (profsites != 0)
+        putlong(IF_BSSBLOCK, (profcounters - bss) + 8*profsites);
+}
+
+//////// Reading the profile
+
+// Add up the counts for this module from every run in the profile.
+// Returns the number of runs found.
+static int readprofile(char *profname, int nsites)
+{
+    FILE *input;
+    char line[512];
+    char *name;
+    int n, i, pos, runs;
+    unsigned int exec, fall;
+
+    profexec = calloc(nsites + 1, sizeof(double));
+    proffall = calloc(nsites + 1, sizeof(double));
+    if ((profexec == NULL) || (proffall == NULL))
+    {
+        fprintf(stderr, "Out of memory for the profile\n");
+        exit(1);
+    }
+
+    input = fopen(profname, "r");
+    if (input == NULL)
+    {
+        fprintf(stderr, "Can't open profile '%s' - code not rearranged\n", profname);
+        return 0;
+    }
+
+    runs = 0;
+    while (fgets(line, sizeof(line), input) != NULL)
+    {
+        if (sscanf(line, "module %d %n", &n, &pos) != 1)
+            continue;
+        name = &line[pos];
+        name[strcspn(name, "\r\n")] = 0;
+
+        // Only a block for this module (compiled the same way) counts
+        if ((n == nsites) && (strncmp(name, modname, PROFNAMESZ - 1) == 0))
+        {
+            for (i = 0; i < n; i++)
+            {
+                if (fgets(line, sizeof(line), input) == NULL)
+                    break;
+                if (sscanf(line, "%u %u", &exec, &fall) == 2)
+                {
+                    profexec[i] += exec;
+                    proffall[i] += fall;
+                }
+            }
+            runs += 1;
+        }
+        else
+        {
+            for (i = 0; i < n; i++)
+                if (fgets(line, sizeof(line), input) == NULL)
+                    break;
+        }
+    }
+
+    fclose(input);
+    if (runs == 0)
+        fprintf(stderr, "No profile for '%s' in '%s' - code not rearranged\n", modname, profname);
+    return runs;
+}
+
+//////// Rearranging
+
+struct pmove {
+    // the conditional jump, and the first and last record moved
+    int jump, first, last;
+    // the IF_SETFIX the records go in front of
+    int dest;
+    // the new label for the moved records
+    int label;
+    // non-zero if line numbers were moved too
+    int lines;
+};
+
+// Can this record be moved with the code around it?
+static int movable(int type)
+{
+    switch(type)
+    {
+    case IF_OBJ:
+    case IF_DATA:
+    case IF_CONST:
+    case IF_DISPLAY:
+    case IF_BSS:
+    case IF_JUMP:
+    case IF_JCOND:
+    case IF_CALL:
+    case IF_LABEL:
+    case IF_REFLABEL:
+    case IF_REFEXT:
+    case IF_SWT:
+    case IF_LINE:
+    case IF_ABSEXT:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+// Does this IF_SETFIX close a routine with an event handler?
+// (stack fixup <location> <amount> <eventmask> <event entry> <from>)
+static int trapsevents(int i)
+{
+    if (precords[i].length < 6)
+        return 0;
+    return codeword(&precords[i].data[4]) != 0;
+}
+
+// the condition that is the reverse of the one given
+static int invertcondition(int condition)
+{
+    int i;
+
+    for (i = 0; i < 10; i++)
+        if (jcondop[i] == jfalseop[condition])
+            return i;
+    return condition;
+}
+
+static void rearrange(char *profname)
+{
+    int i, j, nsites, site, label, nmoves, top, moved, target;
+    int *enclosing, *closer, *lineat, *movedby, *stack;
+    struct pmove *moves, *mp;
+    unsigned char b[3];
+
+    nsites = 0;
+    for (i = 0; i < nprecords; i++)
+        if (precords[i].type == IF_JCOND)
+            nsites += 1;
+
+    // (a module without conditional jumps has no profile)
+    if ((nsites == 0) || (readprofile(profname, nsites) == 0))
+    {
+        for (i = 0; i < nprecords; i++)
+            putrecord(i);
+        return;
+    }
+
+    enclosing = calloc(nprecords + 1, sizeof(int));
+    closer = calloc(nprecords + 1, sizeof(int));
+    lineat = calloc(nprecords + 1, sizeof(int));
+    movedby = calloc(nprecords + 1, sizeof(int));
+    stack = calloc(nprecords + 1, sizeof(int));
+    moves = calloc(nsites + 1, sizeof(struct pmove));
+    if ((enclosing == NULL) || (closer == NULL) || (lineat == NULL) ||
+        (movedby == NULL) || (stack == NULL) || (moves == NULL))
+    {
+        fprintf(stderr, "Out of memory for the profile\n");
+        exit(1);
+    }
+
+    // Find the routine each record is in (and the IF_SETFIX which
+    // closes it), the line number in force and the highest label
+    top = 0;
+    label = 0;
+    lineat[0] = -1;
+    for (i = 0; i < nprecords; i++)
+    {
+        enclosing[i] = (top > 0) ? stack[top - 1] : -1;
+        closer[i] = -1;
+        lineat[i + 1] = lineat[i];
+        movedby[i] = -1;
+        switch(precords[i].type)
+        {
+        case IF_FIXUP:
+            stack[top++] = i;
+            break;
+        case IF_SETFIX:
+            if (top > 0)
+                closer[stack[--top]] = i;
+            break;
+        case IF_LINE:
+            lineat[i + 1] = codeword(precords[i].data);
+            break;
+        case IF_LABEL:
+        case IF_JUMP:
+        case IF_CALL:
+        case IF_REFLABEL:
+        case IF_SWTWORD:
+            j = codeword(precords[i].data);
+            if (j > label) label = j;
+            break;
+        case IF_JCOND:
+            j = codeword(&precords[i].data[1]);
+            if (j > label) label = j;
+            break;
+        }
+    }
+
+    // Now choose the code to move
+    nmoves = 0;
+    site = 0;
+    for (i = 0; i < nprecords; i++)
+    {
+        if (precords[i].type != IF_JCOND)
+            continue;
+        site += 1;
+
+        // mostly taken?
+        if ((profexec[site - 1] < PROFMINCOUNT) ||
+            (2 * proffall[site - 1] >= profexec[site - 1]))
+            continue;
+        // not already moved, and inside a routine
+        if ((movedby[i] >= 0) || (enclosing[i] < 0) || (closer[enclosing[i]] < 0))
+            continue;
+        // and not in a routine which traps events
+        if (trapsevents(closer[enclosing[i]]))
+            continue;
+        if (label >= MAXLABELID - 1)
+            break;
+
+        // find the end of the code the jump falls into
+        moved = -1;
+        for (j = i + 1; j < nprecords; j++)
+        {
+            if ((movedby[j] >= 0) || (movable(precords[j].type) == 0))
+                break;
+            if (precords[j].type == IF_JUMP)
+            {
+                moved = j;
+                break;
+            }
+        }
+        if (moved < 0)
+            continue;
+
+        // which must be followed by the label the jump goes to
+        target = codeword(&precords[i].data[1]);
+        for (j = moved + 1; (j < nprecords) && (precords[j].type == IF_LABEL); j++)
+            if (codeword(precords[j].data) == target)
+                break;
+        if ((j >= nprecords) || (precords[j].type != IF_LABEL))
+            continue;
+
+        mp = &moves[nmoves];
+        mp->jump = i;
+        mp->first = i + 1;
+        mp->last = moved;
+        mp->dest = closer[enclosing[i]];
+        mp->label = ++label;
+        mp->lines = (lineat[moved + 1] != lineat[i + 1]);
+        for (j = mp->first; j <= mp->last; j++)
+            movedby[j] = nmoves;
+        movedby[i] = -2 - nmoves;
+        nmoves += 1;
+    }
+
+    // and write out the new arrangement
+    for (i = 0; i < nprecords; i++)
+    {
+        if (movedby[i] >= 0)
+            continue;
+
+        if (precords[i].type == IF_SETFIX)
+        {
+            // plant the moved code (jumped round, in case the
+            // routine does not end with a return)
+            top = 0;
+            for (j = 0; j < nmoves; j++)
+            {
+                mp = &moves[j];
+                if (mp->dest != i)
+                    continue;
+                if (top == 0)
+                {
+                    top = ++label;
+                    putword(IF_JUMP, top);
+                }
+                putword(IF_LABEL, mp->label);
+                if ((precords[mp->first].type != IF_LINE) && (lineat[mp->first] >= 0))
+                    putword(IF_LINE, lineat[mp->first]);
+                for (site = mp->first; site <= mp->last; site++)
+                    putrecord(site);
+            }
+            if (top != 0)
+            {
+                putword(IF_LABEL, top);
+                if (lineat[i] >= 0)
+                    putword(IF_LINE, lineat[i]);
+            }
+        }
+
+        if (movedby[i] <= -2)
+        {
+            // the inverted jump, to the code moved out of line
+            mp = &moves[-2 - movedby[i]];
+            b[0] = invertcondition(precords[i].data[0]);
+            b[1] = mp->label & 255;
+            b[2] = (mp->label >> 8) & 255;
+            putifrecord(IF_JCOND, 3, b);
+            // the code which follows was after the moved lines
+            if (mp->lines && (lineat[mp->last + 1] >= 0))
+                putword(IF_LINE, lineat[mp->last + 1]);
+        }
+        else
+            putrecord(i);
+    }
+
+    free(enclosing);
+    free(closer);
+    free(lineat);
+    free(movedby);
+    free(stack);
+    free(moves);
+}
+
+// Read the records of the named .ibj file (or from store if inname is
+// NULL), and leave the instrumented or rearranged records in store
+void profileibj(char *inname, int mode, char *profname)
+{
+    int i;
+
+    readrecords(inname);
+    clearifstore();
+
+    profsites = 0;
+    if (mode == PROF_INSTRUMENT)
+        instrument();
+    else if (mode == PROF_LAYOUT)
+        rearrange(profname);
+    else
+        for (i = 0; i < nprecords; i++)
+            putrecord(i);
+
+    for (i = 0; i < nprecords; i++)
+        free(precords[i].data);
+    nprecords = 0;
+}
@@ -0,0 +1,38 @@
+// IMP Compiler for 80386 - pass 3
+// Profile guided block layout
+
+// An instrumented module counts, for every conditional jump, how
+// often the jump is reached and how often it falls through.  The
+// counters live in the module's .bss, and the run time library finds
+// them at exit through a header the module has in its "improf"
+// section.  It writes them out to the profile file, one block of
+// counts per module (see prim-rtl-prof.c in the run time library).
+//
+// When a module is compiled again with the profile, a conditional
+// jump which is mostly taken has its fall through code moved out of
+// line to the end of the routine, and the jump inverted, so that the
+// hot path runs straight on.
+
+// What to do with the intermediate records before making the object
+#define PROF_NONE       0 // nothing
+#define PROF_INSTRUMENT 1 // count the conditional jumps
+#define PROF_LAYOUT     2 // rearrange the code using a profile
+
+// The header of each module in the "improf" section
+// (which the run time library must agree with)
+#define PROFSECTION     "improf"
+#define PROFMAGIC       0x46525049  // "IPRF"
+#define PROFHEADERSZ    256
+#define PROFNAMESZ      (PROFHEADERSZ - 12)
+
+// The profile file, unless it is named by IMPPROFILE
+#define PROFFILE        "imp.prof"
+
+// After instrumenting, the number of conditional jumps counted and
+// where their counters (two words for each) start in the .bss
+extern int profsites;
+extern int profcounters;
+
+// Read the records of the named .ibj file (or from store if inname is
+// NULL), and leave the instrumented or rearranged records in store
+void profileibj(char *inname, int mode, char *profname);
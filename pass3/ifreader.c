@@ -5,8 +5,80 @@
 // For debug purposes, the elements are all written as ascii
 // hex characters, where <type> and <length> are each a single
 // digit, length refers to the number of bytes (2 chars) of data.
+//
+// When pass3 is linked into the compiler, pass2 hands the records
+// over in store instead (see putifrecord), and they are read back
+// by passing a NULL file to readifrecord.  In store each record is
+// simply held as <type><length><data> bytes, with no hex encoding.
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pass3core.h"
+
+// cond jump to label JE, JNE, JG, JGE, JL, JLE, JA, JAE, JB, JBE
+unsigned char jcondop[10] = {
+    0x74, 0x75, 0x7F, 0x7D, 0x7C, 0x7E, 0x77, 0x73, 0x72, 0x76,
+};
+
+// and the jump taken when the condition is false
+unsigned char jfalseop[10] = {
+    0x75, 0x74, 0x7E, 0x7C, 0x7D, 0x7F, 0x76, 0x72, 0x73, 0x77,
+};
+
+// the in-store copy of the intermediate records
+static unsigned char *ifstore = NULL;
+static int ifstoresize = 0;
+static int ifstorelimit = 0;
+static int ifstoreptr = 0;
+
+// Append one record to the in-store intermediate file
+void putifrecord(int type, int length, unsigned char *data)
+{
+	if (ifstoresize + length + 2 > ifstorelimit)
+	{
+		ifstorelimit = (ifstorelimit == 0) ? 65536 : 2*ifstorelimit;
+		ifstore = realloc(ifstore, ifstorelimit);
+		if (ifstore == NULL)
+		{
+			fprintf(stderr, "Out of memory for the intermediate records\n");
+			exit(1);
+		}
+	}
+	ifstore[ifstoresize++] = type;
+	ifstore[ifstoresize++] = length;
+	memcpy(&ifstore[ifstoresize], data, length);
+	ifstoresize += length;
+}
+
+// Start reading the in-store records again from the beginning
+void rewindifstore()
+{
+	ifstoreptr = 0;
+}
+
+// Throw away the in-store records, ready to put a new set
+void clearifstore()
+{
+	ifstoresize = 0;
+	ifstoreptr = 0;
+}
+
+static void readifstore(int *type, int *length, unsigned char *buffer)
+{
+	int l;
+
+	if (ifstoreptr >= ifstoresize)	// end of file
+	{
+		*type = -1;
+		return;
+	}
+	*type = ifstore[ifstoreptr++];
+	l = ifstore[ifstoreptr++];
+	*length = l;
+	memcpy(buffer, &ifstore[ifstoreptr], l);
+	ifstoreptr += l;
+}
 
 static int readnibble(FILE *infile)
 {
@@ -29,6 +101,12 @@ void readifrecord(FILE *infile, int *type, int *length, unsigned char *buffer)
 {
 	int t, l, c1, c2;
 
+	if (infile == NULL)
+	{
+		readifstore(type, length, buffer);
+		return;
+	}
+
 	for (;;)
 	{
 		t = fgetc(infile);
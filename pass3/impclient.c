@@ -0,0 +1,116 @@
+// IMP Compiler for 80386 - resident compiler client
+// Have a compile done by an impdriver left running as a server
+
+// Usage: impclient <socket> <impdriver> <impdriver parameters>
+//
+// The server ("impdriver -serve <socket> <perm>") runs the compile in a copy
+// of itself, in this directory, with this environment and writing to
+// this program's standard streams, so that it looks just as if the
+// impdriver named had been run.  The exit status is the compile's.
+// If there is no server on the socket, the impdriver named is run
+// instead.  See lib/prim-rtl-serve.c for the form of a request.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+extern char **environ;
+
+static int writeall(int fd, char *buffer, int length)
+{
+    int n;
+
+    while (length > 0)
+    {
+        n = write(fd, buffer, length);
+        if (n <= 0)
+            return 0;
+        buffer += n;
+        length -= n;
+    }
+    return 1;
+}
+
+// Add a string (with its NUL) to the request
+static char *add(char *p, char *s)
+{
+    int n = strlen(s) + 1;
+
+    memcpy(p, s, n);
+    return p + n;
+}
+
+int main(int argc, char **argv)
+{
+    struct sockaddr_un addr;
+    int header[3];
+    int fds[3] = { 0, 1, 2 };
+    char control[CMSG_SPACE(sizeof(fds))];
+    char cwd[4096];
+    struct iovec iov;
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+    char *strings, *p;
+    int conn, length, nenv, status, i;
+
+    if (argc < 3)
+    {
+        fprintf(stderr, "Usage: impclient <socket> <impdriver> <parameters>\n");
+        exit(1);
+    }
+
+    conn = socket(AF_UNIX, SOCK_STREAM, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, argv[1], sizeof(addr.sun_path) - 1);
+    if ((conn < 0) || (getcwd(cwd, sizeof(cwd)) == NULL)
+        || (connect(conn, (struct sockaddr *)&addr, sizeof(addr)) != 0))
+    {
+        // no server, so do it here
+        execv(argv[2], argv + 2);
+        perror(argv[2]);
+        exit(1);
+    }
+
+    length = strlen(cwd) + 1;
+    for (i = 2; i < argc; i++)
+        length += strlen(argv[i]) + 1;
+    for (nenv = 0; environ[nenv] != NULL; nenv++)
+        length += strlen(environ[nenv]) + 1;
+    strings = malloc(length);
+    if (strings == NULL)
+        exit(1);
+    p = add(strings, cwd);
+    for (i = 2; i < argc; i++)
+        p = add(p, argv[i]);
+    for (i = 0; i < nenv; i++)
+        p = add(p, environ[i]);
+
+    header[0] = argc - 2;
+    header[1] = nenv;
+    header[2] = length;
+    iov.iov_base = header;
+    iov.iov_len = sizeof(header);
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    if ((sendmsg(conn, &msg, 0) != sizeof(header))
+        || !writeall(conn, strings, length)
+        || (read(conn, &status, sizeof(status)) != sizeof(status)))
+    {
+        fprintf(stderr, "impclient: the server at %s failed\n", argv[1]);
+        exit(1);
+    }
+    exit(status);
+}
@@ -25,10 +25,12 @@
 :do_bootstrap
 @call :do_c2obj ifreader
 @call :do_c2obj writebig
+@call :do_c2obj ibjprof
 @call :do_c2obj pass3coff -DMSVC
 @call :do_c2obj pass3elf  -DMSVC
 @call :do_link pass3coff ifreader writebig
-@call :do_link pass3elf  ifreader writebig
+@call :do_link pass3elf  ifreader writebig ibjprof
+@call :do_createlib pass3coff -DMSVC
 @goto the_end
 
 :rebuild
@@ -45,6 +47,7 @@
 :do_install
 @copy/y pass3coff.exe   %IMP_INSTALL_HOME%\bin\*
 @copy/y pass3elf.exe    %IMP_INSTALL_HOME%\bin\*
+@copy/y pass3lib.lib    %IMP_INSTALL_HOME%\lib\*
 @copy/y imp32.bat       %IMP_INSTALL_HOME%\bin\*
 @copy/y imp32link.bat   %IMP_INSTALL_HOME%\bin\*
 @goto the_end
@@ -58,6 +61,7 @@
 @if exist *.map del *.map
 @if exist *.obj del *.obj
 @if exist *.exe del *.exe
+@if exist *.lib del *.lib
 @goto the_end
 
 :superclean
@@ -74,8 +78,19 @@
 %option% /Fo%module%.obj /Fa%module%.lst %module%.c
 @exit/b
 
+:do_createlib
+@rem the compiler calls pass3 in-process through pass3lib.lib
+@set module=%1
+@set option=%2
+@cl /nologo /Gd /c /Gs /W3 /Od /arch:IA32 -D_CRT_SECURE_NO_WARNINGS /FAscu ^
+%option% -DPASS3LIB /Fopass3lib.obj /Fapass3lib.lst %module%.c
+
+@if exist pass3lib.lib del pass3lib.lib
+@lib /nologo /out:pass3lib.lib pass3lib.obj ifreader.obj writebig.obj
+@exit/b
+
 :do_link
-@set objlist=%1 %2 %3
+@set objlist=%1 %2 %3 %4
 @rem This link command line references the C heap library code
 @link ^
 /nologo ^
@@ -101,6 +116,8 @@
 @echo     install:      - files released to the binary folder %IMP_INSTALL_HOME%\bin are:
 @echo                         - pass3coff.exe  (used to convert .ibj file to a COFF file .obj)
 @echo                         - pass3elf.exe   (used to convert .ibj file to a ELF  file .o)
+@echo                     and to the library folder %IMP_INSTALL_HOME%\lib:
+@echo                         - pass3lib.lib   (pass3coff for the compiler to call in-process)
 @echo                         - imp32.bar
 @echo                         - imp32link.bat
 @echo.
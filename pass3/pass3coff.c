@@ -65,6 +65,8 @@ struct label {
     int labelid;
     int address;
     int flags;
+    // the chunk (top level routine) it is in
+    int chunk;
 };
 #define MAXLABEL 10000
 struct label labels[MAXLABEL];
@@ -298,6 +300,28 @@ static int newsharename(char * name)
 // we need to know how many there are when constructing the Object file.
 int nreloc = 0;
 
+// Alignment (in bytes) asked for by Pass2 for the const, data and
+// bss sections.  It only ever grows, so we keep the largest.
+int constalign = 4;
+int dataalign = 4;
+int bssalign = 4;
+
+// and the fixed alignment of the code, trap table and line table
+// sections (the run time library walks the trap and line tables
+// expecting these)
+int codealign = 16;
+int trapalign = 32;
+int linealign = 256;
+
+// the section flag bit for a COMDAT section
+#define LNKCOMDAT       0x00001000
+
+static void needalign(int *align, int value)
+{
+    if (value > *align)
+        *align = value;
+}
+
 // As we build the external symbol table we count them too...
 int nsymdefs = 0;
 
@@ -314,6 +338,92 @@ int linelimitflag = 0;
 
 char modulename[256];
 
+// When all the code of a module is inside its top level routines
+// (as in a file of external routines) each of those routines gets
+// its own COMDAT code section, with its trap entries and line numbers
+// in sections that go with it, so that the linker can drop (and fold)
+// routines that are never called.
+struct chunk {
+    // the first item record (the items between two top level routines
+    // go with the later one)
+    int firstitem;
+    // code addresses of the start and end of the routine
+    int start;
+    int end;
+    // the stackfix records of the routine and any nested routines
+    int firstfix;
+    int nfix;
+    // its code relocation records
+    int firstreloc;
+    int nreloc;
+    // its line records
+    int firstline;
+    int nlines;
+    // size of its line table block
+    int linesize;
+    // external section numbers of its code, trap and line sections
+    int section;
+    int trapsection;
+    int linesection;
+    // symbol table index of its code section
+    int symbol;
+};
+#define MAXCHUNK MAXSTACK
+struct chunk chunks[MAXCHUNK];
+int nchunks = 0;
+// cleared if the code can't be split by routine
+int splitcode = 1;
+
+// Given an item index, return the index of the chunk it is in
+static int chunkofitem(int i)
+{
+    int k;
+
+    k = 0;
+    while ((k + 1 < nchunks) && (chunks[k + 1].firstitem <= i))
+        k += 1;
+    return k;
+}
+
+// Given a code address, return the index of the chunk it is in
+static int chunkofaddress(int addr)
+{
+    int k;
+
+    k = 0;
+    while ((k + 1 < nchunks) && (chunks[k + 1].start <= addr))
+        k += 1;
+    return k;
+}
+
+// Open the named .ibj file, or if inname is NULL read the records
+// that pass2 left in store (when pass3 is linked into the compiler)
+static FILE *openinput(char *inname)
+{
+    FILE *input;
+
+    if (inname == NULL)
+    {
+        rewindifstore();
+        return NULL;
+    }
+
+    input = fopen(inname, "r");
+    if (input == NULL)
+    {
+        perror("Can't open input file");
+        fprintf(stderr, "Can't open input file '%s'\n",inname);
+        exit(1);
+    }
+    return input;
+}
+
+static void closeinput(FILE *input)
+{
+    if (input != NULL)
+        fclose(input);
+}
+
 // The first pass through the input file, where we collect all the
 // data we will need to map out the object code
 static void readpass1(char *inname)
@@ -324,18 +434,18 @@ static void readpass1(char *inname)
     int type, length, current, ptr, id, value, cad;
     int count;
     int i;
+    int depth, chunkend, nextitem;
     unsigned char buffer[256];
 
-    input = fopen(inname, "r");
-    if (input == NULL)
-    {
-        perror("Can't open input file");
-        fprintf(stderr, "Can't open input file '%s'\n",inname);
-        exit(1);
-    }
+    input = openinput(inname);
 
     lineno = 0;
     cad = 0;
+    // routine nesting, end of the last top level routine, and
+    // the first item of the next one
+    depth = 0;
+    chunkend = 0;
+    nextitem = 0;
 
     current = newitem(IF_OBJ);
     for(;;)
@@ -349,7 +459,13 @@ static void readpass1(char *inname)
         // Are we at the end of file marker?
         if (type < 0)
         {
-            fclose(input);
+            closeinput(input);
+            // no splitting if there is code after the last routine, or
+            // for the main program and the trap and line limit modules
+            if ((nchunks == 0) || (depth != 0) || (cad != chunkend))
+                splitcode = 0;
+            if ((mainprogflag != 0) || (traplimitflag != 0) || (linelimitflag != 0))
+                splitcode = 0;
             return;
         }
 
@@ -459,8 +575,21 @@ static void readpass1(char *inname)
             m[current].size = 4;
             // amount to subtract from the stack will be filled later
             m[current].info = 0;
-            cad += 4;
             ptr = newstack();
+            // a top level routine starts a new chunk, but there must
+            // be no code between it and the previous one
+            if (depth == 0)
+            {
+                if (cad != chunkend)
+                    splitcode = 0;
+                chunks[nchunks].firstitem = nextitem;
+                chunks[nchunks].start = cad;
+                chunks[nchunks].firstfix = ptr;
+                chunks[nchunks].firstreloc = nreloc;
+                nchunks += 1;
+            }
+            depth += 1;
+            cad += 4;
             // get the id number for fixup
             stackfix[ptr].id = (buffer[1] << 8) | buffer[0];
             // point to this code item
@@ -504,6 +633,19 @@ static void readpass1(char *inname)
             }
             if (ptr == ns)
                 fprintf(stderr, "Stack fixup for undefined ID?\n");
+            // the end of a top level routine ends its chunk
+            if (depth > 0)
+            {
+                depth -= 1;
+                if (depth == 0)
+                {
+                    chunks[nchunks - 1].end = cad;
+                    chunks[nchunks - 1].nfix = ns - chunks[nchunks - 1].firstfix;
+                    chunks[nchunks - 1].nreloc = nreloc - chunks[nchunks - 1].firstreloc;
+                    chunkend = cad;
+                    nextitem = nm;
+                }
+            }
             break;
 
         case IF_REQEXT:
@@ -578,6 +720,9 @@ static void readpass1(char *inname)
             }
             // NOTE - these are actually halfwords (=2 bytes)
             m[current].size += 2;
+            // with an optional alignment
+            if (length == 4)
+                needalign(&constalign, buffer[2] | (buffer[3] << 8));
             break;
 
         case IF_DATWORD:
@@ -595,16 +740,33 @@ static void readpass1(char *inname)
                 // old format of IF_DATWORD
                 count = 1;
             }
-            else if (length == 4)
+            else if (length >= 4)
             {
                 // new format of IF_DATWORD
                 count = buffer[2] | (buffer[3] << 8);
             }
+            // with an optional alignment
+            if (length == 6)
+                needalign(&dataalign, buffer[4] | (buffer[5] << 8));
 
             // determine how many bytes required
             m[current].size += (2*count);
             break;
 
+        case IF_BSSBLOCK:
+            // reserve a block of BSS, with an optional alignment
+            if ((length != WORDSIZE) && (length != 2*WORDSIZE))
+                fprintf(stderr, "ERR_BADRECSZ: IF_BSSBLOCK, line %d\n",lineno);
+            if (length == 2*WORDSIZE)
+                needalign(&bssalign, buffer[4] | (buffer[5] << 8) | (buffer[6] << 16) | (buffer[7] << 24));
+            if (m[current].what != IF_BSSBLOCK)
+            {
+                current = newitem(IF_BSSBLOCK);
+                m[current].size = 0;
+            }
+            m[current].size += buffer[0] | (buffer[1] << 8) | (buffer[2] << 16) | (buffer[3] << 24);
+            break;
+
         case IF_SWTWORD:
             // switch table entry - actually a label ID
             if (m[current].what != IF_SWTWORD)
@@ -869,6 +1031,7 @@ static void initlabels()
                 }
                 labels[ptr].labelid = id;
                 labels[ptr].address = cad;
+                labels[ptr].chunk = chunkofitem(i);
                 break;
 
             case IF_FIXUP:
@@ -921,6 +1084,10 @@ static void initlabels()
                 // Data section word (repeated)
                 break;
 
+            case IF_BSSBLOCK:
+                // BSS block takes no code space
+                break;
+
             case IF_SWTWORD:
                 // switch table entry - actually a label ID
                 // tag referenced label as used
@@ -985,6 +1152,56 @@ static void initlabels()
     }
 }
 
+// When the code is split by routine, work out which lines go with
+// each routine, and count the jumps, calls and label references from
+// one routine to another, because they need relocation records too.
+static void initchunks()
+{
+    int i, k, type, ptr, nextreloc;
+
+    if (splitcode == 0)
+        return;
+
+    for (k = 0; k < nchunks; k++)
+    {
+        chunks[k].firstline = 0;
+        chunks[k].nlines = 0;
+    }
+    // the lines are in address order, so each routine has a run of them
+    for (i = nlines - 1; i >= 0; i--)
+    {
+        k = chunkofaddress(lines[i].offset);
+        chunks[k].firstline = i;
+        chunks[k].nlines += 1;
+    }
+
+    for (i = 0; i < nm; i++)
+    {
+        type = m[i].what;
+        if ((type == IF_JUMP) || (type == IF_JCOND) || (type == IF_CALL) || (type == IF_REFLABEL))
+        {
+            ptr = findlabel(m[i].info);
+            k = chunkofitem(i);
+            if (labels[ptr].chunk != k)
+            {
+                chunks[k].nreloc += 1;
+                nreloc += 1;
+            }
+        }
+    }
+
+    nextreloc = 0;
+    for (k = 0; k < nchunks; k++)
+    {
+        chunks[k].firstreloc = nextreloc;
+        nextreloc += chunks[k].nreloc;
+        // a line table block is a header, then the entries padded out
+        // to a multiple of the header size
+        chunks[k].linesize = LINEHEADERSZ
+                + ((chunks[k].nlines * LINEENTRYSZ + LINEHEADERSZ - 1) & ~(LINEHEADERSZ - 1));
+    }
+}
+
 // Simple routine that tries to "improve" the jumps.
 // It returns "true" if it found an improvement.
 // Unfortunately we need to iterate because every
@@ -1189,6 +1406,11 @@ void computesizes()
             datacount += size;
             break;
 
+        case IF_BSSBLOCK:
+            // zeroed data
+            bsscount += size;
+            break;
+
         case IF_SWTWORD:
             // switch table entry - actually a label ID
             // so "size" is 16 bit words (= label id),
@@ -1257,6 +1479,8 @@ void computesizes()
 // the preceding one.  Then there is going to be the relocation list,
 // the line-number list, the symbol table, and the string table (for
 // names longer than 8 chars).
+// When the code is split by routine, the code, trap and line sections
+// are each replaced by one per routine, which share out the same data.
 struct cofffilehdr	filehead;
 
 // Internal coff sections, according to the file writer
@@ -1284,6 +1508,7 @@ int directsection;
 int codesection;
 int constsection;
 int datasection;
+int bsssection;
 int swtabsection;
 int trapsection;
 int traplimitsection;
@@ -1294,6 +1519,7 @@ struct coffscnhdr   directhead;
 struct coffscnhdr   codehead;
 struct coffscnhdr   consthead;
 struct coffscnhdr   datahead;
+struct coffscnhdr   bsshead;
 struct coffscnhdr   swtabhead;
 struct coffscnhdr   traphead;
 struct coffscnhdr   traplimithead;
@@ -1347,9 +1573,24 @@ int extsyms;
 // local variable used to avoid repeated addition calculation
 int syms;
 
+// The section flag bits for an alignment (in bytes, a power of 2)
+static int alignflags(int align)
+{
+    int bits;
+
+    bits = 1;
+    while ((align > 1) && (bits < 14))
+    {
+        align = align >> 1;
+        bits += 1;
+    }
+    return (bits << 20);
+}
+
 void initobjectfile(FILE * output)
 {
-    int dataoffset, i, filesyms;
+    int dataoffset, i, k, filesyms, leadersyms, lineptr;
+    struct coffscnhdr head;
 
     if (mainprogflag != 0)
     {
@@ -1361,12 +1602,24 @@ void initobjectfile(FILE * output)
 
     // how many sections we'll need (always one for directive)
     nsections = 1;
-    if (codecount  != 0) nsections += 1;
     if (constcount != 0) nsections += 1;
     if (datacount  != 0) nsections += 1;
+    if (bsscount   != 0) nsections += 1;
     if (swtabcount != 0) nsections += 1;
-    if (trapcount  != 0) nsections += 1;
-    if (linecount  != 0) nsections += 1;
+    if (splitcode != 0)
+    {
+        // a code and a trap section for every routine, and a line
+        // section for every routine that has line numbers
+        nsections += 2*nchunks;
+        for (k = 0; k < nchunks; k++)
+            if (chunks[k].nlines != 0) nsections += 1;
+    }
+    else
+    {
+        if (codecount  != 0) nsections += 1;
+        if (trapcount  != 0) nsections += 1;
+        if (linecount  != 0) nsections += 1;
+    }
     // for the dummy trap table limit section
     if (traplimitflag != 0) nsections += 1;
     // for the dummy line table limit section
@@ -1386,7 +1639,14 @@ void initobjectfile(FILE * output)
     // Current LINEHEADERSZ is 256
     // 252 byte for filename string
     // 4 bytes for count of entries
-    if (linelimitflag == 0)
+    if (splitcode != 0)
+    {
+        // one line table block for each routine that has lines
+        linesize = 0;
+        for (k = 0; k < nchunks; k++)
+            if (chunks[k].nlines != 0) linesize += chunks[k].linesize;
+    }
+    else if (linelimitflag == 0)
     {
         linesize = LINEHEADERSZ*(2 + (linecount * LINEENTRYSZ)/LINEHEADERSZ);
     }
@@ -1395,7 +1655,10 @@ void initobjectfile(FILE * output)
     // use a little magic to know in advance how many records the .file symbol takes
     filesyms       = (strlen(path_buffer) + 36)/18;
 
-    intsyms = (nsections*2) + filesyms + 1;
+    // each routine's code section has its name as a static leader symbol
+    leadersyms     = (splitcode != 0) ? nchunks : 0;
+
+    intsyms = (nsections*2) + filesyms + 1 + leadersyms;
     extsyms = nsymdefs + nspecs;
 
     // data starts after all the headers
@@ -1406,7 +1669,6 @@ void initobjectfile(FILE * output)
                     + datasize
                     + constsize
                     + swtabsize
-                    + bsssize
                     + trapsize
                     + traplimitsize
                     + linesize
@@ -1415,7 +1677,7 @@ void initobjectfile(FILE * output)
     trapreloffset  = swtabreloffset + swtabcount * SZRELOC;
     linereloffset  = trapreloffset  + trapcount * TRAPENTRYRELOC * SZRELOC;
     symtaboffset   = linereloffset  + nlines * SZRELOC;
-    strtaboffset   = symtaboffset   + (nsymdefs + nspecs + (nsections*2) + filesyms + 1) * SZSYMENT;
+    strtaboffset   = symtaboffset   + (nsymdefs + nspecs + (nsections*2) + filesyms + 1 + leadersyms) * SZSYMENT;
 
     setfile(output, dataoffset);
     setsize(DIRECTIVE_SECTION, SZDIRECTIVE);
@@ -1462,7 +1724,7 @@ void initobjectfile(FILE * output)
 //    codehead.s_nlnno    = nlines;
     codehead.s_nlnno    = 0;
     // readable executable 16 byte aligned code
-    codehead.s_flags    = 0x60500020;
+    codehead.s_flags    = 0x60000020 | alignflags(codealign);
     dataoffset += codesize;
 
     strcpy(consthead.s_name, ".rdata");
@@ -1474,8 +1736,8 @@ void initobjectfile(FILE * output)
     consthead.s_lnnoptr = 0;
     consthead.s_nreloc  = 0;
     consthead.s_nlnno   = 0;
-    // read only 4 byte aligned initialised data
-    consthead.s_flags   = 0x40300040;
+    // read only initialised data, aligned as Pass2 asked
+    consthead.s_flags   = 0x40000040 | alignflags(constalign);
     dataoffset += constsize;
 
     strcpy(datahead.s_name, ".data");
@@ -1487,10 +1749,23 @@ void initobjectfile(FILE * output)
     datahead.s_lnnoptr  = 0;
     datahead.s_nreloc   = 0;
     datahead.s_nlnno    = 0;
-    // read/writable 4 byte aligned initialised data
-    datahead.s_flags    = 0xC0300040;
+    // read/writable initialised data, aligned as Pass2 asked
+    datahead.s_flags    = 0xC0000040 | alignflags(dataalign);
     dataoffset += datasize;
 
+    // the BSS takes no space in the file
+    strcpy(bsshead.s_name, ".bss");
+    bsshead.s_paddr     = 0;
+    bsshead.s_vaddr     = 0;
+    bsshead.s_size      = bsssize;
+    bsshead.s_scnptr    = 0;
+    bsshead.s_relptr    = 0;
+    bsshead.s_lnnoptr   = 0;
+    bsshead.s_nreloc    = 0;
+    bsshead.s_nlnno     = 0;
+    // read/writable uninitialised data, aligned as Pass2 asked
+    bsshead.s_flags     = 0xC0000080 | alignflags(bssalign);
+
     strcpy(swtabhead.s_name, "_SWTAB");
     swtabhead.s_paddr   = 0;
     swtabhead.s_vaddr   = 0;
@@ -1525,7 +1800,7 @@ void initobjectfile(FILE * output)
     traphead.s_nreloc   = trapcount * TRAPENTRYRELOC;
     traphead.s_nlnno    = 0;
     // read only 32 byte aligned initialised data
-    traphead.s_flags    = 0x40600040;
+    traphead.s_flags    = 0x40000040 | alignflags(trapalign);
     dataoffset += trapsize;
 
     // the limit section will be linked after all other trap tables
@@ -1540,7 +1815,7 @@ void initobjectfile(FILE * output)
     traplimithead.s_nreloc  = 0;
     traplimithead.s_nlnno   = 0;
     // read only 32 byte aligned initialised data
-    traplimithead.s_flags   = 0x40600040;
+    traplimithead.s_flags   = 0x40000040 | alignflags(trapalign);
     dataoffset += traplimitsize;
 
     // In order that we can traverse the line table at run time we want
@@ -1562,7 +1837,7 @@ void initobjectfile(FILE * output)
         linehead.s_nreloc   = linecount * LINEENTRYRELOC;
         linehead.s_nlnno    = 0;
         // read only 256 byte aligned initialised data
-        linehead.s_flags    = 0x40900040;
+        linehead.s_flags    = 0x40000040 | alignflags(linealign);
         dataoffset += linesize;
     }
     else if (linelimitflag == 0)
@@ -1578,7 +1853,7 @@ void initobjectfile(FILE * output)
         linehead.s_nreloc   = linecount * LINEENTRYRELOC;
         linehead.s_nlnno    = 0;
         // read only 256 byte aligned initialised data
-        linehead.s_flags    = 0x40900040;
+        linehead.s_flags    = 0x40000040 | alignflags(linealign);
         dataoffset += linesize;
     }
     else
@@ -1595,7 +1870,7 @@ void initobjectfile(FILE * output)
         linelimithead.s_nreloc  = 0;
         linelimithead.s_nlnno   = 0;
         // read only 256 byte aligned initialised data
-        linelimithead.s_flags   = 0x40900040;
+        linelimithead.s_flags   = 0x40000040 | alignflags(linealign);
         dataoffset += linelimitsize;
     }
 
@@ -1604,7 +1879,7 @@ void initobjectfile(FILE * output)
     filehead.f_nscns    = nsections;
     filehead.f_timdat   = (time(NULL) & 0xffffffff);
     filehead.f_symptr   = symtaboffset;
-    filehead.f_nsyms    = nsymdefs + nspecs + (nsections*2) + filesyms + 1;
+    filehead.f_nsyms    = nsymdefs + nspecs + (nsections*2) + filesyms + 1 + leadersyms;
     filehead.f_opthdr   = 0;
     filehead.f_flags    = 0;
 
@@ -1618,7 +1893,29 @@ void initobjectfile(FILE * output)
     // to count off the sections - directive is #1, so next will be #2
     i = 2;
 
-    if (codecount  != 0)
+    if (splitcode != 0)
+    {
+        // each routine's slice of the code, picked once only, with
+        // its slice of the code relocations
+        codesection = 0;
+        for (k = 0; k < nchunks; k++)
+        {
+            head = codehead;
+            strcpy(head.s_name, ".text$I");
+            head.s_size   = chunks[k].end - chunks[k].start;
+            head.s_scnptr = codehead.s_scnptr + chunks[k].start;
+            if (chunks[k].nreloc == 0)
+                head.s_relptr = 0;
+            else
+                head.s_relptr = codereloffset + chunks[k].firstreloc * SZRELOC;
+            head.s_nreloc = chunks[k].nreloc;
+            // as .text, but COMDAT
+            head.s_flags  = codehead.s_flags | LNKCOMDAT;
+            fwrite(&head, 1, SZSECHDR, output);
+            chunks[k].section = i++;
+        }
+    }
+    else if (codecount  != 0)
     {
         fwrite(&codehead, 1, SZSECHDR, output);
         codesection = i++;
@@ -1642,6 +1939,14 @@ void initobjectfile(FILE * output)
     else
         datasection = 0;
 
+    if (bsscount   != 0)
+    {
+        fwrite(&bsshead, 1, SZSECHDR, output);
+        bsssection = i++;
+    }
+    else
+        bsssection = 0;
+
     if (swtabcount != 0)
     {
         fwrite(&swtabhead, 1, SZSECHDR, output);
@@ -1650,7 +1955,25 @@ void initobjectfile(FILE * output)
     else
         swtabsection = 0;
 
-    if (trapcount  != 0)
+    if (splitcode != 0)
+    {
+        // the trap entries of each routine (and its nested routines)
+        // go with its code section
+        trapsection = 0;
+        for (k = 0; k < nchunks; k++)
+        {
+            head = traphead;
+            head.s_size   = chunks[k].nfix * TRAPENTRYSZ;
+            head.s_scnptr = traphead.s_scnptr + chunks[k].firstfix * TRAPENTRYSZ;
+            head.s_relptr = trapreloffset + chunks[k].firstfix * TRAPENTRYRELOC * SZRELOC;
+            head.s_nreloc = chunks[k].nfix * TRAPENTRYRELOC;
+            // as the trap table, but COMDAT
+            head.s_flags  = traphead.s_flags | LNKCOMDAT;
+            fwrite(&head, 1, SZSECHDR, output);
+            chunks[k].trapsection = i++;
+        }
+    }
+    else if (trapcount  != 0)
     {
         fwrite(&traphead, 1, SZSECHDR, output);
         trapsection = i++;
@@ -1666,7 +1989,31 @@ void initobjectfile(FILE * output)
     else
         traplimitsection = 0;
 
-    if (linecount  != 0)
+    if (splitcode != 0)
+    {
+        // and so do its line numbers, as a line table block of its own
+        linesection = 0;
+        lineptr = linehead.s_scnptr;
+        for (k = 0; k < nchunks; k++)
+        {
+            if (chunks[k].nlines == 0)
+            {
+                chunks[k].linesection = 0;
+                continue;
+            }
+            head = linehead;
+            head.s_size   = chunks[k].linesize;
+            head.s_scnptr = lineptr;
+            head.s_relptr = linereloffset + chunks[k].firstline * LINEENTRYRELOC * SZRELOC;
+            head.s_nreloc = chunks[k].nlines * LINEENTRYRELOC;
+            // as the line table, but COMDAT
+            head.s_flags  = linehead.s_flags | LNKCOMDAT;
+            fwrite(&head, 1, SZSECHDR, output);
+            chunks[k].linesection = i++;
+            lineptr += chunks[k].linesize;
+        }
+    }
+    else if (linecount  != 0)
     {
         fwrite(&linehead, 1, SZSECHDR, output);
         linesection = i++;
@@ -1699,6 +2046,7 @@ int directivesymbol;
 int codesymbol;
 int constsymbol;
 int datasymbol;
+int bsssymbol;
 int swtabsymbol;
 int trapsymbol;
 int traplimitsymbol;
@@ -1716,7 +2064,7 @@ static void putsectionsymbols(FILE *output)
 {
     struct coffsyment sym;
     struct coffauxscn aux;
-    int sequence, count, length, symbol;
+    int sequence, count, length, symbol, k;
     char * filename;
 
     fseek(output, symtaboffset, 0);
@@ -1805,7 +2153,47 @@ static void putsectionsymbols(FILE *output)
     symbol += 2;
 
     // code
-    if (codecount != 0)
+    if (splitcode != 0)
+    {
+        for (k = 0; k < nchunks; k++)
+        {
+            sequence += 1;
+            // to make sure we get a clean name
+            sym.n.n_n.n_offset = 0;
+            strcpy(sym.n.n_name, ".text$I");
+            sym.n_scnum = sequence;
+            fwrite(&sym, 1, SZSYMENT, output);
+            symtaboffset += SZSYMENT;
+
+            aux.x_scnlen = chunks[k].end - chunks[k].start;
+            aux.x_nreloc = chunks[k].nreloc;
+            aux.x_nlnno = 0;
+            // the routine is unique to this module
+            aux.x_selno = 1;
+            fwrite(&aux, 1, SZSYMENT, output);
+            symtaboffset += SZSYMENT;
+            aux.x_selno = 0;
+
+            // followed by the COMDAT symbol, which is the routine's
+            // debug name as a static function
+            sym.n.n_n.n_zeroes = 0;
+            sym.n.n_n.n_offset = 0;
+            if (strlen(&named[stackfix[chunks[k].firstfix].namep]) <= 8)
+                strcpy(sym.n.n_name, &named[stackfix[chunks[k].firstfix].namep]);
+            else
+                sym.n.n_n.n_offset = stackfix[chunks[k].firstfix].namep + 4;
+            sym.n_type = 0x20;
+            sym.n_numaux = 0;
+            fwrite(&sym, 1, SZSYMENT, output);
+            symtaboffset += SZSYMENT;
+            sym.n_type = 0;
+            sym.n_numaux = 1;
+
+            chunks[k].symbol = symbol;
+            symbol += 3;
+        }
+    }
+    else if (codecount != 0)
     {
         sequence += 1;
         // to make sure we get a clean name
@@ -1867,6 +2255,27 @@ static void putsectionsymbols(FILE *output)
         symbol += 2;
     }
 
+    // bss
+    if (bsscount != 0)
+	{
+        sequence += 1;
+        // to make sure we get a clean name
+        sym.n.n_n.n_offset = 0;
+        strcpy(sym.n.n_name, ".bss");
+        sym.n_scnum = sequence;
+        fwrite(&sym, 1, SZSYMENT, output);
+        symtaboffset += SZSYMENT;
+
+        aux.x_scnlen = bsscount*BYTESZ;
+        aux.x_nreloc = 0;
+        aux.x_nlnno = 0;
+        fwrite(&aux, 1, SZSYMENT, output);
+        symtaboffset += SZSYMENT;
+
+        bsssymbol = symbol;
+        symbol += 2;
+    }
+
     // switch
     if (swtabcount != 0)
     {
@@ -1889,7 +2298,33 @@ static void putsectionsymbols(FILE *output)
     }
 
     // trap
-    if (trapcount  != 0)
+    if (splitcode != 0)
+    {
+        for (k = 0; k < nchunks; k++)
+        {
+            sequence += 1;
+            // to make sure we get a clean name
+            sym.n.n_n.n_offset = 0;
+            strcpy(sym.n.n_name, "_ITRAP$D");
+            sym.n_scnum = sequence;
+            fwrite(&sym, 1, SZSYMENT, output);
+            symtaboffset += SZSYMENT;
+
+            aux.x_scnlen = chunks[k].nfix * TRAPENTRYSZ;
+            aux.x_nreloc = chunks[k].nfix * TRAPENTRYRELOC;
+            aux.x_nlnno = 0;
+            // kept or dropped along with the routine's code
+            aux.x_secno = chunks[k].section;
+            aux.x_selno = 5;
+            fwrite(&aux, 1, SZSYMENT, output);
+            symtaboffset += SZSYMENT;
+            aux.x_secno = 0;
+            aux.x_selno = 0;
+
+            symbol += 2;
+        }
+    }
+    else if (trapcount  != 0)
     {
         sequence += 1;
         // to make sure we get a clean name
@@ -1934,7 +2369,35 @@ static void putsectionsymbols(FILE *output)
     }
 
     // line
-    if (linecount  != 0)
+    if (splitcode != 0)
+    {
+        for (k = 0; k < nchunks; k++)
+        {
+            if (chunks[k].nlines == 0)
+                continue;
+            sequence += 1;
+            // to make sure we get a clean name
+            sym.n.n_n.n_offset = 0;
+            strcpy(sym.n.n_name, "_ILINE$D");
+            sym.n_scnum = sequence;
+            fwrite(&sym, 1, SZSYMENT, output);
+            symtaboffset += SZSYMENT;
+
+            aux.x_scnlen = chunks[k].linesize;
+            aux.x_nreloc = chunks[k].nlines * LINEENTRYRELOC;
+            aux.x_nlnno = 0;
+            // kept or dropped along with the routine's code
+            aux.x_secno = chunks[k].section;
+            aux.x_selno = 5;
+            fwrite(&aux, 1, SZSYMENT, output);
+            symtaboffset += SZSYMENT;
+            aux.x_secno = 0;
+            aux.x_selno = 0;
+
+            symbol += 2;
+        }
+    }
+    else if (linecount  != 0)
     {
         sequence += 1;
         // to make sure we get a clean name
@@ -2055,7 +2518,7 @@ static void putexternalspecs(FILE *output)
 // write the external definitions to the symbol table
 static void putexternaldefs(FILE *output)
 {
-    int i, type, ptr;
+    int i, k, type, ptr;
     struct coffsyment sym;
     char * name;
 
@@ -2076,6 +2539,13 @@ static void putexternaldefs(FILE *output)
             sym.n_value = m[i].address;
             // section - code
             sym.n_scnum = codesection;
+            // or the code section of its own routine
+            if (splitcode != 0)
+            {
+                k = chunkofitem(i);
+                sym.n_value -= chunks[k].start;
+                sym.n_scnum = chunks[k].section;
+            }
             // this is a function
             sym.n_type = 0x20;
             // external
@@ -2133,16 +2603,33 @@ static void putstringtable(FILE *output)
 // <StartAddr32><EndAddr32><TrapAddr32><FromAddr32><EventMask16><Name[14]>
 static void puttraptable(FILE *output)
 {
-    int i, j, addr;
+    int i, j, k, addr, base;
     struct coffsyment sym;
     struct stfix *sp;
     char *namep;
     int address[4],offset[4];
     int segidx;
 
+    k = 0;
     for (i = 0; i < ns; i++)
     {
         sp = &stackfix[i];
+        // When the code is split by routine, each trap entry goes in the
+        // trap section of its top level routine, relative to its code
+        if (splitcode != 0)
+        {
+            while ((k + 1 < nchunks) && (chunks[k + 1].firstfix <= i))
+                k += 1;
+            base = chunks[k].start;
+            segidx = chunks[k].symbol;
+            addr = (i - chunks[k].firstfix) * TRAPENTRYSZ;
+        }
+        else
+        {
+            base = 0;
+            segidx = codesymbol;
+            addr = i * TRAPENTRYSZ;
+        }
         // Obtain the offset values of the various locations
         // Each value is an offset inside the .text section
         offset[0] = sp->start;
@@ -2173,11 +2660,15 @@ static void puttraptable(FILE *output)
         // address[3] = offset[3] - offset[0];
 
         // Decision:
-        // Use as relocation base, the .text symbol
-        segidx = codesymbol;
+        // Use as relocation base, the .text symbol (or the routine's
+        // own code section symbol when the code is split by routine).
+        // A routine with no trap has no trap labels, so those point
+        // at the base
         for (j=0; j < 4; j++)
         {
-            address[j] = offset[j];
+            if (offset[j] < base)
+                offset[j] = base;
+            address[j] = offset[j] - base;
         }
 
         // add the location of the routine start
@@ -2204,7 +2695,7 @@ static void puttraptable(FILE *output)
         // - start/end/entry/from
         // These all need relocating by the base symbol chosen
         // so we do four relocation records next...
-        addr = i * 32;  // address of first words to relocate
+        // (addr is the address of the first word to relocate)
         for (j=0; j < 4; j++)
         {
             // offset in this section of the word to relocate
@@ -2319,7 +2810,7 @@ static void putlineheader( int sectionid, int linecount )
 // Fill in the line number section of the object file
 static void putlinenumbers(FILE *output)
 {
-    int i,remainder;
+    int i,k,remainder;
     struct coffsyment sym;
     int segidx;
 
@@ -2328,8 +2819,40 @@ static void putlinenumbers(FILE *output)
     // Field 2) line count (32-bit count of line entries)
     // Field 3..line count + 3) line address, line number (array of pair of 32-integers)
 
+    // When the code is split by routine, each routine with lines
+    // has a line table block of its own, relative to its code
+    if (splitcode != 0)
+    {
+        for (k = 0; k < nchunks; k++)
+        {
+            if (chunks[k].nlines == 0)
+                continue;
+            putlineheader( LINE_SECTION, chunks[k].nlines );
+
+            for (i = 0; i < chunks[k].nlines; i++)
+            {
+                writew32(LINE_SECTION, lines[chunks[k].firstline + i].line);
+                writew32(LINE_SECTION, lines[chunks[k].firstline + i].offset - chunks[k].start);
+            }
+            // pad the block out to its full size, so the next one follows
+            remainder = chunks[k].linesize - LINEHEADERSZ - chunks[k].nlines*LINEENTRYSZ;
+            for (i=0;i < remainder;i++)
+            {
+                writebyte(LINE_SECTION, 0);
+            }
+
+            // relocate by the routine's code section symbol
+            segidx = chunks[k].symbol;
+            for (i = 0;i < chunks[k].nlines; i++)
+            {
+                writew32(LINEREL_SECTION, LINEHEADERSZ + 4 * (2*i + 1));
+                writew32(LINEREL_SECTION, segidx);
+                writew16(LINEREL_SECTION, 6);
+            }
+        }
+    }
     // Add the linelimit data + symbol?
-    if (linelimitflag == 0)
+    else if (linelimitflag == 0)
     {
         // This is an ordinary LINE section
         putlineheader( LINE_SECTION, nlines );
@@ -2416,14 +2939,23 @@ static void putlinenumbers(FILE *output)
     }
 }
 
-// cond jump to label JE, JNE, JG, JGE, JL, JLE, JA, JAE, JB, JBE
-static unsigned char jcondop[10] = {
-    0x74, 0x75, 0x7F, 0x7D, 0x7C, 0x7E, 0x77, 0x73, 0x72, 0x76,
-};
-
-static unsigned char jfalseop[10] = {
-    0x75, 0x74, 0x7E, 0x7C, 0x7D, 0x7F, 0x76, 0x72, 0x73, 0x77,
-};
+// When the code is split by routine, a jump, call or label reference
+// to another routine's code section is left to the linker, as a
+// relative address from that section.  The word to relocate is at
+// "addr" in the current code section.
+static void putchunkref(int addr, int ptr, int offset)
+{
+    struct chunk *cp;
+
+    cp = &chunks[labels[ptr].chunk];
+    writew32(CODE_SECTION, labels[ptr].address - cp->start - offset);
+    // offset in the section of the word to relocate
+    writew32(CODEREL_SECTION, addr);
+    // symbol for the other section
+    writew32(CODEREL_SECTION, cp->symbol);
+    // relocate by relative 32 bit address
+    writew16(CODEREL_SECTION, 0x14);
+}
 
 // Main Pass - Reread the input file and write the object code
 static void putcode(FILE *input, FILE *output)
@@ -2431,11 +2963,16 @@ static void putcode(FILE *input, FILE *output)
     int type, length, current, ptr, id, value, condition, cad, i, segidx;
     int swtp, offset;
     int count;
+    int chunk, base;
     unsigned char buffer[256];
 
     current = 0;
     cad = 0;
     swtp = 0;
+    // the current routine's chunk, and its start (relocations are
+    // relative to the start of the routine's code section)
+    chunk = 0;
+    base = 0;
     for(;;)
     {
         readifrecord(input, &type, &length, buffer);
@@ -2462,7 +2999,7 @@ static void putcode(FILE *input, FILE *output)
             segidx = datasymbol;
 
             // offset in the section of the word to relocate
-            writew32(CODEREL_SECTION, cad);
+            writew32(CODEREL_SECTION, cad - base);
             // symbol for section
             writew32(CODEREL_SECTION, segidx);
             // relocate by actual 32 bit address
@@ -2480,7 +3017,7 @@ static void putcode(FILE *input, FILE *output)
             segidx = constsymbol;
 
             // offset in the section of the word to relocate
-            writew32(CODEREL_SECTION, cad);
+            writew32(CODEREL_SECTION, cad - base);
             // symbol for section
             writew32(CODEREL_SECTION, segidx);
             // relocate by actual 32 bit address
@@ -2511,7 +3048,10 @@ static void putcode(FILE *input, FILE *output)
                 // JMP
                 writebyte(CODE_SECTION, 0xE9);
                 value = value - (m[current].address + 5);
-                writew32(CODE_SECTION, value);
+                if ((splitcode != 0) && (labels[ptr].chunk != chunk))
+                    putchunkref(cad + 1 - base, ptr, 0);
+                else
+                    writew32(CODE_SECTION, value);
                 cad += 5;
             }
             break;
@@ -2537,7 +3077,10 @@ static void putcode(FILE *input, FILE *output)
                 writebyte(CODE_SECTION, 0x0F);
                 writebyte(CODE_SECTION, jcondop[condition] + 0x10);
                 value = value - (m[current].address + 6);
-                writew32(CODE_SECTION, value);
+                if ((splitcode != 0) && (labels[ptr].chunk != chunk))
+                    putchunkref(cad + 2 - base, ptr, 0);
+                else
+                    writew32(CODE_SECTION, value);
                 cad += 6;
             }
             break;
@@ -2552,7 +3095,10 @@ static void putcode(FILE *input, FILE *output)
             // write a CALL instruction
             writebyte(CODE_SECTION, 0xE8);
             value = value - (m[current].address + 5);
-            writew32(CODE_SECTION, value);
+            if ((splitcode != 0) && (labels[ptr].chunk != chunk))
+                putchunkref(cad + 1 - base, ptr, 0);
+            else
+                writew32(CODE_SECTION, value);
             cad += 5;
             break;
 
@@ -2600,6 +3146,12 @@ static void putcode(FILE *input, FILE *output)
                     break;
                 }
             }
+            // a top level routine starts the next code section
+            if ((splitcode != 0) && (chunk + 1 < nchunks) && (chunks[chunk + 1].firstfix == ptr))
+            {
+                chunk += 1;
+                base = chunks[chunk].start;
+            }
             cad += 4;
             break;
 
@@ -2640,7 +3192,10 @@ static void putcode(FILE *input, FILE *output)
             // REFLABEL is WORDSIZE, then extra offset
             value = value - (m[current].address + WORDSIZE + offset);
             // we now have the relative address + optional offset of label from current location
-            writew32(CODE_SECTION, value);
+            if ((splitcode != 0) && (labels[ptr].chunk != chunk))
+                putchunkref(cad - base, ptr, offset);
+            else
+                writew32(CODE_SECTION, value);
             cad += 4;
             break;
 
@@ -2660,7 +3215,7 @@ static void putcode(FILE *input, FILE *output)
             id += firstusersymbol;
 
             // note the offset in section of word to relocate
-            writew32(CODEREL_SECTION, cad);
+            writew32(CODEREL_SECTION, cad - base);
             // indicate the symbol index for this reference
             writew32(CODEREL_SECTION, id);
             // relocate by relative 32 bit address
@@ -2670,7 +3225,29 @@ static void putcode(FILE *input, FILE *output)
             break;
 
         case IF_BSS:
-            // BSS should have been converted to OBJ
+            // BSS section offset word
+            if (m[current].what != IF_OBJ)
+                current += 1;
+            for (i=0; i < WORDSIZE; i++)
+                writebyte(CODE_SECTION, buffer[i]);
+
+            segidx = bsssymbol;
+
+            // offset in the section of the word to relocate
+            writew32(CODEREL_SECTION, cad - base);
+            // symbol for section
+            writew32(CODEREL_SECTION, segidx);
+            // relocate by actual 32 bit address
+            writew16(CODEREL_SECTION, 6);
+            cad += WORDSIZE;
+            break;
+
+        case IF_BSSBLOCK:
+            // BSS block - nothing is written, the section is zeroed
+            if (m[current].what != IF_BSSBLOCK)
+            {
+                current += 1;
+            }
             break;
 
         case IF_COTWORD:
@@ -2697,7 +3274,7 @@ static void putcode(FILE *input, FILE *output)
                 // old format of IF_DATWORD
                 count = 1;
             }
-            else if (length == 4)
+            else if (length >= 4)
             {
                 // new format of IF_DATWORD
                 count = buffer[2] | (buffer[3] << 8);
@@ -2722,13 +3299,20 @@ static void putcode(FILE *input, FILE *output)
             id = buffer[0] | (buffer[1] << 8);
             ptr = findlabel(id);
             value = labels[ptr].address;
+            segidx = codesymbol;
+            // or relative to the code section of the label's routine
+            if (splitcode != 0)
+            {
+                value -= chunks[labels[ptr].chunk].start;
+                segidx = chunks[labels[ptr].chunk].symbol;
+            }
 
             writew32(SWTAB_SECTION, value);
             // we must also plant a relocation record to make this a code address
             // put the offset in section of word to relocate
             writew32(SWTABREL_SECTION, swtp);
             // put the symbol for section
-            writew32(SWTABREL_SECTION, codesymbol);
+            writew32(SWTABREL_SECTION, segidx);
             // relocate by actual 32 bit address
             writew16(SWTABREL_SECTION, 6);
             swtp += 4;
@@ -2762,7 +3346,7 @@ static void putcode(FILE *input, FILE *output)
             segidx = swtabsymbol;
 
             // note the offset in the section of the word to relocate
-            writew32(CODEREL_SECTION, cad);
+            writew32(CODEREL_SECTION, cad - base);
             // note the symbol for the section
             writew32(CODEREL_SECTION, segidx);
             // relocate by actual 32 bit address
@@ -2792,7 +3376,7 @@ static void putcode(FILE *input, FILE *output)
             id += firstusersymbol;
 
             // put the offset in the section of the word to relocate
-            writew32(CODEREL_SECTION, cad);
+            writew32(CODEREL_SECTION, cad - base);
             // put the symbol index for this reference
             writew32(CODEREL_SECTION, id);
             // and relocate by actual 32 bit address
@@ -2825,49 +3409,19 @@ void dumpobjectfile( char *inname, char *outname )
 {
     FILE * in;
     FILE * out;
-    int i;
-
-    // in order to get a useful debug output, we try to recreate the input
-    // file name by assuming that the intermediate files have the same base
-    // name and are in the same directory as the source.
-#ifdef MSVC
-    // turn it into a full name
-    _fullpath(path_buffer, inname, _MAX_PATH);
-#else
-    //    realpath(inname, path_buffer);
-    strcpy(path_buffer,realpath(inname, NULL));
-#endif
-    // At this point we have the full filename of the input file
-    // held in the path_buffer char array.
 
-    // Now tweak the file extension from .ibj to .imp
-    // Only need to alter the last two chars
-    // NB char array index starts at 0
-    i = strlen(path_buffer);
-    path_buffer[i - 2] = 'm';
-    path_buffer[i - 1] = 'p';
-    // Now put it in the string table
+    // The IMP source name (in path_buffer) goes in the string table
     path_index = newname(path_buffer);
 
-    // So, first open the input file
-    in = fopen(inname, "r");
-
-    // Next tweak the inname to form the output (,o) filename
-    i = strlen(inname);
-
-    // First: tweak the file extension from .ibj to .obj
-    // Only need to alter the last two chars
-    // NB char array index starts at 0
-    inname[i - 3] = 'o';
-    inname[i - 2] = 'b';
-    inname[i - 1] = 'j';
+    // So, first open the input file (again)
+    in = openinput(inname);
 
     // Now open the output file
     out = fopen(outname, "wb");
     if (out == NULL)
     {
         perror("Can't open output file");
-        fprintf(stderr, "Can't open output file '%s'\n",inname);
+        fprintf(stderr, "Can't open output file '%s'\n",outname);
         exit(1);
     }
 
@@ -2891,24 +3445,46 @@ void dumpobjectfile( char *inname, char *outname )
 
     flushout();
 
-    fclose(in);
+    closeinput(in);
     fclose(out);
 }
 
-int main(int argc, char **argv)
+// Put the full name of a file in path_buffer (done the same way
+// whether pass3 is a program or is linked into the compiler)
+static void fullname(char *name)
 {
-    int size;
+#ifdef MSVC
+    // turn it into a full name
+    _fullpath(path_buffer, name, _MAX_PATH);
+#else
+    char *full;
 
-    if (argc != 3)
+    full = realpath(name, NULL);
+    if (full == NULL)
     {
-        fprintf(stderr, "Unexpected number of parameters for PASS3COFF!\n\n");
-        fprintf(stderr, "Usage:  PASS3 <intermediatefile> <objfile>?\n");
-        exit(1);
+        // not there (yet), so use the name as it stands
+        strncpy(path_buffer, name, sizeof(path_buffer) - 1);
     }
+    else
+    {
+        strncpy(path_buffer, full, sizeof(path_buffer) - 1);
+        free(full);
+    }
+    path_buffer[sizeof(path_buffer) - 1] = 0;
+#endif
+}
+
+// Make the object file from the intermediate records, which are
+// read from the named .ibj file or (if inname is NULL) from store.
+// The name of the IMP source is already in path_buffer
+static void makeobject(char *inname, char *outname)
+{
+    int size;
 
-    readpass1( argv[1] );
+    readpass1( inname );
 
     initlabels();
+    initchunks();
 
 //    while (improvejumpsizes())
 //        initlabels();
@@ -2916,7 +3492,7 @@ int main(int argc, char **argv)
 
     remapspecs();
 
-    dumpobjectfile( argv[1], argv[2] );
+    dumpobjectfile( inname, outname );
 
     fprintf(stderr, "\n\n");
     fprintf(stderr, " COFF object file generated from IMP source file: '%s'\n",path_buffer);
@@ -2940,6 +3516,114 @@ int main(int argc, char **argv)
                     size + codesize + trapsize);
     fprintf(stderr, " +----------+----------+----------+---------+---------+---------+------------+\n");
     fprintf(stderr, "\n\n");
+}
+
+#ifdef PASS3LIB
+// Put everything back as it was before the first object was made,
+// so that the next compile in the same process starts afresh
+void pass3reset()
+{
+    nm = 0;
+    memset(m, 0, sizeof(m));
+    nl = 1;
+    memset(labels, 0, sizeof(labels));
+    ns = 0;
+    memset(stackfix, 0, sizeof(stackfix));
+    commentdp = 0;
+    namedp = 0;
+    sharedp = 0;
+    nlines = 0;
+    memset(lines, 0, sizeof(lines));
+    nspecs = 0;
+    memset(specs, 0, sizeof(specs));
+    lastlinead = -1;
+    nreloc = 0;
+    constalign = 4;
+    dataalign = 4;
+    bssalign = 4;
+    nsymdefs = 0;
+    mainprogflag = 0;
+    traplimitflag = 0;
+    linelimitflag = 0;
+    modulename[0] = 0;
+    nchunks = 0;
+    memset(chunks, 0, sizeof(chunks));
+    splitcode = 1;
+
+    codecount = 0;
+    codesize = 0;
+    constcount = 0;
+    constsize = 0;
+    datacount = 0;
+    datasize = 0;
+    bsscount = 0;
+    bsssize = 0;
+    swtabcount = 0;
+    swtabsize = 0;
+    trapcount = 0;
+    trapsize = 0;
+    traplimitsize = 0;
+    linecount = 0;
+    linesize = 0;
+    linelimitsize = 0;
+
+    path_buffer[0] = 0;
+    path_index = 0;
+    memset(&filehead, 0, sizeof(filehead));
+    nsections = 0;
+    intsyms = 0;
+    extsyms = 0;
+    syms = 0;
+
+    resetsections();
+}
+
+// Entry point when pass3 is linked into the compiler (impdriver).
+// The records come from the named .ibj file or, if ibjname is NULL
+// or empty, from the in-store copy that pass2 handed over through
+// putifrecord.  The source name is the name of the IMP source.
+// pass3elf has the same entry point, so the compiler need not know
+// which object format it is making
+void pass3object(char *ibjname, char *sourcename, char *outname)
+{
+    if ((ibjname != NULL) && (*ibjname == 0))
+        ibjname = NULL;
+
+    pass3reset();
+    fullname(sourcename);
+    makeobject(ibjname, outname);
+
+    // the records have been used, so the next compile starts empty
+    clearifstore();
+}
+#else
+int main(int argc, char **argv)
+{
+    int i;
+
+    if (argc != 3)
+    {
+        fprintf(stderr, "Unexpected number of parameters for PASS3COFF!\n\n");
+        fprintf(stderr, "Usage:  PASS3 <intermediatefile> <objfile>?\n");
+        exit(1);
+    }
+
+    // in order to get a useful debug output, we try to recreate the input
+    // file name by assuming that the intermediate files have the same base
+    // name and are in the same directory as the source.
+    fullname(argv[1]);
+    // At this point we have the full filename of the input file
+    // held in the path_buffer char array.
+
+    // Now tweak the file extension from .ibj to .imp
+    // Only need to alter the last two chars
+    // NB char array index starts at 0
+    i = strlen(path_buffer);
+    path_buffer[i - 2] = 'm';
+    path_buffer[i - 1] = 'p';
+
+    makeobject( argv[1], argv[2] );
 
     exit(0);
 }
+#endif
@@ -1,4 +1,7 @@
 void readifrecord(FILE *infile, int *type, int *length, unsigned char *buffer);
+void putifrecord(int type, int length, unsigned char *data);
+void rewindifstore();
+void clearifstore();
 void writeobjectrecord(FILE *outfile, int type, int count, unsigned char * data);
 
 // Intermediate file types:
@@ -27,6 +30,7 @@ void writeobjectrecord(FILE *outfile, int type, int count, unsigned char * data)
 #define IF_ABSEXT      22 // W - external name absolute offset code word (data external)
 #define IF_VERSION     23 // X - IBJ File Format version
 #define IF_COMMENT     24 // Y - Text comment string
+#define IF_BSSBLOCK    25 // Z - reserve a block of (zeroed) BSS
 
 #define IBJMajor        1 // Current IBJ Major Version Level of IBJ File Format
 #define IBJMinor        0 // Current IBJ Minor Version Level of IBJ File Format
@@ -34,9 +38,16 @@ void writeobjectrecord(FILE *outfile, int type, int count, unsigned char * data)
 
 #define WORDSIZE	4
 
+// The opcodes of IF_JCOND's conditions JE, JNE, JG, JGE, JL, JLE, JA,
+// JAE, JB, JBE (as short jumps - add 0x10 after a 0x0F for the near
+// form), and of their inverses (in ifreader.c)
+extern unsigned char jcondop[10];
+extern unsigned char jfalseop[10];
+
 // Interface to ELF/COFF file writer
 void setsize(int section, int s);
 void setfile(FILE * out, int offset);
+void resetsections();
 void writebyte(int section, unsigned char b);
 void writew16(int section, int w);
 void writew32(int section, int w);
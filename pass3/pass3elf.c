@@ -14,6 +14,7 @@
 #include <stdint.h>
 #include "pass3core.h"
 #include "pass3elf.h"
+#include "ibjprof.h"
 
 #define BYTESZ          1
 #define SWTABENTRYSZ    4
@@ -302,6 +303,18 @@ static int newsharename(char * name)
 // we need to know how many there are when constructing the Object file.
 int nreloc = 0;
 
+// Alignment (in bytes) asked for by Pass2 for the const, data and
+// bss sections.  It only ever grows, so we keep the largest.
+int constalign = 4;
+int dataalign = 4;
+int bssalign = 4;
+
+static void needalign(int *align, int value)
+{
+    if (value > *align)
+        *align = value;
+}
+
 // As we build the external symbol table we count them too...
 int nsymdefs = 0;
 
@@ -318,6 +331,39 @@ int linelimitflag = 0;
 
 char modulename[256];
 
+// what to do about profiling (see ibjprof.c), and the profile to use
+static int profmode = PROF_NONE;
+static char *profname = PROFFILE;
+
+// Open the intermediate file for reading.  A NULL name means the
+// records are already in store (pass3 linked into the compiler),
+// in which case the NULL file tells readifrecord to read them there.
+static FILE *openinput(char *inname)
+{
+    FILE *input;
+
+    if (inname == NULL)
+    {
+        rewindifstore();
+        return NULL;
+    }
+
+    input = fopen(inname, "r");
+    if (input == NULL)
+    {
+        perror("Can't open input file");
+        fprintf(stderr, "Can't open input file '%s'\n",inname);
+        exit(1);
+    }
+    return input;
+}
+
+static void closeinput(FILE *input)
+{
+    if (input != NULL)
+        fclose(input);
+}
+
 // The first pass through the input file, where we collect all the
 // data we will need to map out the object code
 static void readpass1(char *inname)
@@ -330,13 +376,7 @@ static void readpass1(char *inname)
     int i;
     unsigned char buffer[256];
 
-    input = fopen(inname, "r");
-    if (input == NULL)
-    {
-        perror("Can't open input file");
-        fprintf(stderr, "Can't open input file '%s'\n",inname);
-        exit(1);
-    }
+    input = openinput(inname);
 
     lineno = 0;
     cad = 0;
@@ -353,7 +393,7 @@ static void readpass1(char *inname)
         // Are we at the end of file marker?
         if (type < 0)
         {
-            fclose(input);
+            closeinput(input);
             return;
         }
 
@@ -582,6 +622,9 @@ static void readpass1(char *inname)
             }
             // NOTE - these are actually halfwords (=2 bytes)
             m[current].size += 2;
+            // with an optional alignment
+            if (length == 4)
+                needalign(&constalign, buffer[2] | (buffer[3] << 8));
             break;
 
         case IF_DATWORD:
@@ -599,16 +642,33 @@ static void readpass1(char *inname)
                 // old format of IF_DATWORD
                 count = 1;
             }
-            else if (length == 4)
+            else if (length >= 4)
             {
                 // new format of IF_DATWORD
                 count = buffer[2] | (buffer[3] << 8);
             }
+            // with an optional alignment
+            if (length == 6)
+                needalign(&dataalign, buffer[4] | (buffer[5] << 8));
 
             // determine how many bytes required
             m[current].size += (2*count);
             break;
 
+        case IF_BSSBLOCK:
+            // reserve a block of BSS, with an optional alignment
+            if ((length != WORDSIZE) && (length != 2*WORDSIZE))
+                fprintf(stderr, "ERR_BADRECSZ: IF_BSSBLOCK, line %d\n",lineno);
+            if (length == 2*WORDSIZE)
+                needalign(&bssalign, buffer[4] | (buffer[5] << 8) | (buffer[6] << 16) | (buffer[7] << 24));
+            if (m[current].what != IF_BSSBLOCK)
+            {
+                current = newitem(IF_BSSBLOCK);
+                m[current].size = 0;
+            }
+            m[current].size += buffer[0] | (buffer[1] << 8) | (buffer[2] << 16) | (buffer[3] << 24);
+            break;
+
         case IF_SWTWORD:
             // switch table entry - actually a label ID
             if (m[current].what != IF_SWTWORD)
@@ -924,6 +984,10 @@ static void initlabels()
                 // Data section word (repeated)
                 break;
 
+            case IF_BSSBLOCK:
+                // BSS block takes no code space
+                break;
+
             case IF_SWTWORD:
                 // switch table entry - actually a label ID
                 // tag referenced label as used
@@ -1173,6 +1237,11 @@ void computesizes()
             datacount += size;
             break;
 
+        case IF_BSSBLOCK:
+            // zeroed data
+            bsscount += size;
+            break;
+
         case IF_SWTWORD:
             // switch table entry - actually a label ID
             // so "size" is 16 bit words (= label id),
@@ -1300,13 +1369,16 @@ Elf32_Ehdr  filehead;
 #define LINEREL_SECTION   12 // line table relocations   - .rel.line
 #define LINELIMIT_SECTION 13 // line limit marker        - .line.limit
 
-#define COMMENT_SECTION   14 // compiler version         - .comment
-#define SYMTAB_SECTION    15 // symbol table             - .symtab
-#define STRTAB_SECTION    16 // string table of names    - .strtab
-#define SHSTRTAB_SECTION  17 // string table of shnames  - .shstrtab
+#define PROF_SECTION      14 // profile counter header   - improf
+#define PROFREL_SECTION   15 // profile relocations      - .rel.improf
+
+#define COMMENT_SECTION   16 // compiler version         - .comment
+#define SYMTAB_SECTION    17 // symbol table             - .symtab
+#define STRTAB_SECTION    18 // string table of names    - .strtab
+#define SHSTRTAB_SECTION  19 // string table of shnames  - .shstrtab
 // Add in #define entries for extra sections as needed.
 // Don't forget to update SHDR_SECTION to represent the last value
-#define SHDR_SECTION      18 // fake section for the section header table
+#define SHDR_SECTION      20 // fake section for the section header table
 
 // define the relocation type to use
 #define RELOCSZ      sizeof(Elf32_Rel)
@@ -1386,6 +1458,12 @@ Elf32_Off populatesection(    int sectionid,
     section_header[sectionid].sh_addralign = addralign;
     section_header[sectionid].sh_entsize = entsize;
     section_header[sectionid].sh_offset = offset;
+    // a zeroed (NOBITS) section takes no space in the file
+    if (type == SHT_NOBITS)
+    {
+        setsize(sectionid, 0);
+        return offset;
+    }
     setsize(sectionid, size);
 
     return offset + size;
@@ -1464,7 +1542,7 @@ void initobjectfile(FILE * output)
         nsectsyms += 1;
     }
 
-    if (bsscount = 0)
+    if (bsscount != 0)
     {
         section[BSS_SECTION] = nsections++;
         nsectsyms += 1;
@@ -1506,6 +1584,13 @@ void initobjectfile(FILE * output)
         section[LINELIMIT_SECTION] = nsections++;
     }
 
+    // add the profile header only if the code has been instrumented
+    if (profsites != 0)
+    {
+        section[PROF_SECTION] = nsections++;
+        section[PROFREL_SECTION] = nsections++;
+    }
+
     section[COMMENT_SECTION] = nsections++;
     section[SYMTAB_SECTION] = nsections++;
     section[STRTAB_SECTION] = nsections++;
@@ -1565,6 +1650,14 @@ void initobjectfile(FILE * output)
         section_header[LINELIMIT_SECTION].sh_name = newsharename(".imp.line.F");
     }
 
+    if (profsites != 0)
+    {
+        // the run time library finds every module's header
+        // between the linker's __start_improf and __stop_improf
+        section_header[PROF_SECTION].sh_name = newsharename(PROFSECTION);
+        section_header[PROFREL_SECTION].sh_name = newsharename(".rel" PROFSECTION);
+    }
+
     section_header[COMMENT_SECTION].sh_name = newsharename(".comment");
 
     // now set up our file writer so that it can work out the section offsets
@@ -1608,7 +1701,7 @@ void initobjectfile(FILE * output)
                                  SHT_PROGBITS,
                                  SHF_ALLOC,
                                  0,
-                                 4,
+                                 constalign,
                                  0,
                                  dataoffset);
 
@@ -1619,7 +1712,7 @@ void initobjectfile(FILE * output)
                                  SHT_PROGBITS,
                                  SHF_ALLOC|SHF_WRITE,
                                  0,
-                                 4,
+                                 dataalign,
                                  0,
                                  dataoffset);
 
@@ -1630,7 +1723,7 @@ void initobjectfile(FILE * output)
                                  SHT_NOBITS,
                                  SHF_ALLOC|SHF_WRITE,
                                  0,
-                                 4,
+                                 bssalign,
                                  0,
                                  dataoffset);
 
@@ -1745,6 +1838,30 @@ void initobjectfile(FILE * output)
                                  0,
                                  dataoffset);
 
+    // the profile header holds a single relocated word
+    // (the address of the counters in the .bss section)
+    dataoffset = populatesection(PROF_SECTION,
+                                 (profsites != 0) * PROFHEADERSZ,
+                                 0,
+                                 0,
+                                 SHT_PROGBITS,
+                                 SHF_ALLOC|SHF_WRITE,
+                                 0,
+                                 4,
+                                 0,
+                                 dataoffset);
+
+    dataoffset = populatesection(PROFREL_SECTION,
+                                 (profsites != 0) * RELOCSZ,
+                                 section[SYMTAB_SECTION],
+                                 section[PROF_SECTION],
+                                 RELOCTYPE,
+                                 0,
+                                 0,
+                                 4,
+                                 RELOCSZ,
+                                 dataoffset);
+
     dataoffset = populatesection(COMMENT_SECTION,
                                  sizeof(vsncomment),
                                  0,
@@ -1868,6 +1985,12 @@ void initobjectfile(FILE * output)
         writeblock(SHDR_SECTION, (unsigned char *)&section_header[LINELIMIT_SECTION], sizeof(Elf32_Shdr));
     }
 
+    if (profsites != 0)
+    {
+        writeblock(SHDR_SECTION, (unsigned char *)&section_header[PROF_SECTION], sizeof(Elf32_Shdr));
+        writeblock(SHDR_SECTION, (unsigned char *)&section_header[PROFREL_SECTION], sizeof(Elf32_Shdr));
+    }
+
     writeblock(SHDR_SECTION, (unsigned char *)&section_header[COMMENT_SECTION], sizeof(Elf32_Shdr));
 
     writeblock(SHDR_SECTION, (unsigned char *)&section_header[SYMTAB_SECTION],  sizeof(Elf32_Shdr));
@@ -2115,15 +2238,6 @@ static void putexternaldefs(FILE *output)
     }
 }
 
-// cond jump to label JE, JNE, JG, JGE, JL, JLE, JA, JAE, JB, JBE
-static unsigned char jcondop[10] = {
-    0x74, 0x75, 0x7F, 0x7D, 0x7C, 0x7E, 0x77, 0x73, 0x72, 0x76,
-};
-
-static unsigned char jfalseop[10] = {
-    0x75, 0x74, 0x7E, 0x7C, 0x7D, 0x7F, 0x76, 0x72, 0x73, 0x77,
-};
-
 // Main Pass - Reread the input file and write the object code
 static void putcode(FILE *input, FILE *output)
 {
@@ -2369,7 +2483,27 @@ static void putcode(FILE *input, FILE *output)
             break;
 
         case IF_BSS:
-            // BSS should have been converted to OBJ
+            // BSS section offset word
+            if (m[current].what != IF_OBJ)
+                current += 1;
+            for (i=0; i < WORDSIZE; i++)
+                writebyte(CODE_SECTION, buffer[i]);
+
+            segidx = symbols[BSS_SECTION];
+
+            // offset in the section of the word to relocate
+            writew32(CODEREL_SECTION, cad);
+            // symbol for section
+            writew32(CODEREL_SECTION, (segidx<<8)|R_386_32);
+            cad += WORDSIZE;
+            break;
+
+        case IF_BSSBLOCK:
+            // BSS block - nothing is written, the section is zeroed
+            if (m[current].what != IF_BSSBLOCK)
+            {
+                current += 1;
+            }
             break;
 
         case IF_COTWORD:
@@ -2396,7 +2530,7 @@ static void putcode(FILE *input, FILE *output)
                 // old format of IF_DATWORD
                 count = 1;
             }
-            else if (length == 4)
+            else if (length >= 4)
             {
                 // new format of IF_DATWORD
                 count = buffer[2] | (buffer[3] << 8);
@@ -2720,6 +2854,33 @@ static void putlinenumbers(FILE *output)
     }
 }
 
+// Fill in the profile header of an instrumented module
+static void putprofileheader(FILE *output)
+{
+    int i, length;
+
+    if (profsites == 0)
+        return;
+
+    // The header is
+    // Field 1) PROFMAGIC
+    // Field 2) count of conditional jumps (each has a pair of counters)
+    // Field 3) address of the counters (relocated by the .bss symbol)
+    // Field 4) module name (a zero padded C string)
+    writew32(PROF_SECTION, PROFMAGIC);
+    writew32(PROF_SECTION, profsites);
+    writew32(PROF_SECTION, profcounters);
+    writew32(PROFREL_SECTION, 8);
+    writew32(PROFREL_SECTION, (symbols[BSS_SECTION]<<8)|R_386_32);
+
+    length = strlen(modulename);
+    if (length > PROFNAMESZ - 1) length = PROFNAMESZ - 1;
+    for (i = 0; i < length; i++)
+        writebyte(PROF_SECTION, modulename[i]&255);
+    for (i = length; i < PROFNAMESZ; i++)
+        writebyte(PROF_SECTION, 0);
+}
+
 // Write the string table to the output file.  Note that we
 // write all of our internal string table, even though not
 // all of the entries are used/needed by the linker, or even
@@ -2734,27 +2895,16 @@ void dumpobjectfile( char *inname, char *outname )
 {
     FILE * in;
     FILE * out;
-    int i;
-
-    // So, first open the input file
-    in = fopen(inname, "r");
 
-    // Next tweak the inname to form the output (,o) filename
-    i = strlen(inname);
-
-    // First: tweak the file extension from .ibj to .obj
-    // Only need to alter the last two chars
-    // NB char array index starts at 0
-    inname[i - 3] = 'o';
-    inname[i - 2] = 0;
-    inname[i - 1] = 0;
+    // So, first open the input file (again)
+    in = openinput(inname);
 
     // Now open the output file
     out = fopen(outname, "wb");
     if (out == NULL)
     {
         perror("Can't open output file");
-        fprintf(stderr, "Can't open output file '%s'\n",inname);
+        fprintf(stderr, "Can't open output file '%s'\n",outname);
         exit(1);
     }
 
@@ -2788,50 +2938,31 @@ void dumpobjectfile( char *inname, char *outname )
     // now output the line number records for the debugger
     putlinenumbers(out);
 
+    // and the header for the profile counters
+    putprofileheader(out);
+
     putstringtables(out);
 
     flushout();
 
-    fclose(in);
+    closeinput(in);
     fclose(out);
 }
 
-int main(int argc, char **argv)
+// Make the object file from the intermediate records, which are
+// read from the named .ibj file or (if inname is NULL) from store
+static void makeobject(char *inname, char *outname)
 {
-    int i;
     int datasize;
 
-    if (argc != 3)
+    // Instrument or rearrange the records first, leaving them in store
+    if (profmode != PROF_NONE)
     {
-        fprintf(stderr, "Unexpected number of parameters for PASS3ELF!\n\n");
-        fprintf(stderr, "Usage:  PASS3 <intermediatefile> <objfile>?\n");
-        exit(1);
+        profileibj(inname, profmode, profname);
+        inname = NULL;
     }
 
-    // in order to get a useful debug output,
-    // we try to recreate the input file name by assuming that
-    // the .ibj files have the same base name (as the .imp files)
-    // and are in the same directory as the imp source.
-#ifdef MSVC
-    // turn it into a full name
-    _fullpath(path_buffer, argv[1], _MAX_PATH);
-#else
-    strcpy(path_buffer,realpath(argv[1], NULL));
-#endif
-    // At this point we have the full filename of the input file
-    // held in the path_buffer char array.
-
-    // Now tweak the file extension from .ibj to .imp
-    // Only need to alter the last two chars
-    // NB char array index starts at 0
-    i = strlen(path_buffer);
-    path_buffer[i - 2] = 'm';
-    path_buffer[i - 1] = 'p';
-    // Now put it in the string table (as the first entry)
-    path_index = newname(path_buffer);
-
-    // we now continue with the file names specified by argv[1],argv[2]
-    readpass1( argv[1] );
+    readpass1( inname );
 
     initlabels();
 
@@ -2841,7 +2972,7 @@ int main(int argc, char **argv)
 
     remapspecs();
 
-    dumpobjectfile( argv[1], argv[2] );
+    dumpobjectfile( inname, outname );
 
     fprintf(stderr, "\n\n");
     fprintf(stderr, " ELF object file generated from IMP source file: '%s'\n",path_buffer);
@@ -2867,6 +2998,169 @@ int main(int argc, char **argv)
                     + trapcount * TRAPENTRYSZ);
     fprintf(stderr, " +----------+----------+----------+---------+---------+---------+------------+\n");
     fprintf(stderr, "\n\n");
+}
+
+// Put the full name of a file in path_buffer (done the same way
+// whether pass3 is a program or is linked into the compiler)
+static void fullname(char *name)
+{
+#ifdef MSVC
+    // turn it into a full name
+    _fullpath(path_buffer, name, _MAX_PATH);
+#else
+    char *full;
+
+    full = realpath(name, NULL);
+    if (full == NULL)
+    {
+        // not there (yet), so use the name as it stands
+        strncpy(path_buffer, name, sizeof(path_buffer) - 1);
+    }
+    else
+    {
+        strncpy(path_buffer, full, sizeof(path_buffer) - 1);
+        free(full);
+    }
+    path_buffer[sizeof(path_buffer) - 1] = 0;
+#endif
+}
+
+#ifdef PASS3LIB
+// Put everything back as it was before the first object was made,
+// so that the next compile in the same process starts afresh
+void pass3reset()
+{
+    nm = 0;
+    memset(m, 0, sizeof(m));
+    nl = 1;
+    memset(labels, 0, sizeof(labels));
+    ns = 0;
+    memset(stackfix, 0, sizeof(stackfix));
+    commentdp = 0;
+    named[0] = 0;
+    namedp = 1;
+    shared[0] = 0;
+    sharedp = 1;
+    nlines = 0;
+    memset(lines, 0, sizeof(lines));
+    nspecs = 0;
+    memset(specs, 0, sizeof(specs));
+    lastlinead = -1;
+    nreloc = 0;
+    constalign = 4;
+    dataalign = 4;
+    bssalign = 4;
+    nsymdefs = 0;
+    mainprogflag = 0;
+    traplimitflag = 0;
+    linelimitflag = 0;
+    modulename[0] = 0;
+
+    codecount = 0;
+    constcount = 0;
+    datacount = 0;
+    bsscount = 0;
+    swtabcount = 0;
+    trapcount = 0;
+    linecount = 0;
+
+    path_buffer[0] = 0;
+    path_index = 0;
+    memset(&filehead, 0, sizeof(filehead));
+    memset(section, 0, sizeof(section));
+    memset(section_header, 0, sizeof(section_header));
+    memset(symbols, 0, sizeof(symbols));
+    firstusersymbol = 0;
+    nsections = 0;
+    trapbase_index = 0;
+    traplimit_index = 0;
+    linebase_index = 0;
+    linelimit_index = 0;
+    got_index = 0;
+    intsyms = 0;
+    extsyms = 0;
+    syms = 0;
+    nsectsyms = 0;
+
+    resetsections();
+}
+
+// Entry point when pass3 is linked into the compiler (impdriver).
+// The records come from the named .ibj file or, if ibjname is NULL
+// or empty, from the in-store copy that pass2 handed over through
+// putifrecord.  The source name is the name of the IMP source.
+// pass3coff has the same entry point, so the compiler need not know
+// which object format it is making
+void pass3object(char *ibjname, char *sourcename, char *outname)
+{
+    if ((ibjname != NULL) && (*ibjname == 0))
+        ibjname = NULL;
+
+    pass3reset();
+
+    // The IMP source name goes in the string table (as the first entry)
+    fullname(sourcename);
+    path_index = newname(path_buffer);
+
+    makeobject(ibjname, outname);
+
+    // the records have been used, so the next compile starts empty
+    clearifstore();
+}
+#else
+int main(int argc, char **argv)
+{
+    int i;
+
+    // Options (before the file names) are
+    //    -p          count the conditional jumps as the program runs
+    //    -u<file>    rearrange the code using the counts in <file>
+    while ((argc > 3) && (argv[1][0] == '-'))
+    {
+        if (strcmp(argv[1], "-p") == 0)
+            profmode = PROF_INSTRUMENT;
+        else if (strncmp(argv[1], "-u", 2) == 0)
+        {
+            profmode = PROF_LAYOUT;
+            if (argv[1][2] != 0)
+                profname = &argv[1][2];
+        }
+        else
+        {
+            fprintf(stderr, "Unknown option '%s' for PASS3ELF\n", argv[1]);
+            exit(1);
+        }
+        argc -= 1;
+        argv += 1;
+    }
+
+    if (argc != 3)
+    {
+        fprintf(stderr, "Unexpected number of parameters for PASS3ELF!\n\n");
+        fprintf(stderr, "Usage:  PASS3 [-p|-u<profile>] <intermediatefile> <objfile>?\n");
+        exit(1);
+    }
+
+    // in order to get a useful debug output,
+    // we try to recreate the input file name by assuming that
+    // the .ibj files have the same base name (as the .imp files)
+    // and are in the same directory as the imp source.
+    fullname(argv[1]);
+    // At this point we have the full filename of the input file
+    // held in the path_buffer char array.
+
+    // Now tweak the file extension from .ibj to .imp
+    // Only need to alter the last two chars
+    // NB char array index starts at 0
+    i = strlen(path_buffer);
+    path_buffer[i - 2] = 'm';
+    path_buffer[i - 1] = 'p';
+    // Now put it in the string table (as the first entry)
+    path_index = newname(path_buffer);
+
+    // we now continue with the file names specified by argv[1],argv[2]
+    makeobject( argv[1], argv[2] );
 
     exit(0);
 }
+#endif
@@ -30,6 +30,7 @@ typedef struct {
 
 // some simple defines to go in some holes here
 #define	ET_REL      1   // This is a relocatable object file
+#define ET_EXEC     2   // This is an executable file
 #define EM_386      3   // For an Intel 80386
 #define EV_CURRENT  1   // in version 1 of ELF
 
@@ -106,6 +107,7 @@ typedef struct {
 // symbol table bindings
 #define STB_LOCAL   0
 #define STB_GLOBAL  1
+#define STB_WEAK    2
 
 // symbol table types
 #define STT_NOTYPE  0
@@ -113,9 +115,14 @@ typedef struct {
 #define STT_FUNC    2
 #define STT_SECTION 3
 #define STT_FILE    4
+#define STT_COMMON  5
+#define STT_TLS     6
+#define STT_GNU_IFUNC 10
 
 // special section indexes
+#define SHN_UNDEF   0
 #define SHN_ABS     0xfff1
+#define SHN_COMMON  0xfff2
 
 // relocation entries
 typedef struct{
@@ -142,3 +149,32 @@ typedef struct{
 #define R_386_GOTOFF    9
 #define R_386_GOTPC    10
 #define R_386_32PLT    11
+#define R_386_TLS_IE   15
+#define R_386_TLS_GOTIE 16
+#define R_386_TLS_LE   17
+#define R_386_TLS_LE_32 34
+#define R_386_IRELATIVE 42
+#define R_386_GOT32X   43
+
+// ELF Program Header (only needed for executable files)
+typedef struct {
+    Elf32_Word  p_type;
+    Elf32_Off   p_offset;
+    Elf32_Addr  p_vaddr;
+    Elf32_Addr  p_paddr;
+    Elf32_Word  p_filesz;
+    Elf32_Word  p_memsz;
+    Elf32_Word  p_flags;
+    Elf32_Word  p_align;
+} Elf32_Phdr;
+
+// segment types
+#define PT_NULL         0
+#define PT_LOAD         1
+#define PT_TLS          7
+#define PT_GNU_STACK    0x6474e551
+
+// segment permissions
+#define PF_X            1
+#define PF_W            2
+#define PF_R            4
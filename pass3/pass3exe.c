@@ -0,0 +1,891 @@
+// IMP Compiler for 80386 - pass 3
+// Direct ELF executable generator
+
+// This reads one or more intermediate object files produced by the
+// second pass, together with a pre-linked image of the run time
+// library (an ELF relocatable file made once by "ld -r"), and writes
+// a static ELF executable without calling gcc or ld.
+// It does for itself the jobs the linker script ld.i77.script does:
+// the IMP trap and line tables of every module are collected
+// in B,D,F order so that _imptrapbase/_imptraplimit and
+// _implinebase/_implinelimit bracket them.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "pass3core.h"
+#include "pass3elf.h"
+#include "ibjlink.h"
+
+// Where the executable is loaded (the traditional i386 address)
+#define IMAGEBASE       0x08048000
+#define PAGESIZE        0x1000
+
+#define TRAPENTRYSZ     32
+#define LINEHEADERSZ   256
+
+#define TRAPBASE        "_imptrapbase"
+#define TRAPLIMIT       "_imptraplimit"
+#define LINEBASE        "_implinebase"
+#define LINELIMIT       "_implinelimit"
+#define ENTRYNAME       "_start"
+
+// Each kind of section becomes one section of the executable
+static char *kindname[LS_KINDS] = {
+    ".text", ".rodata", ".trap", ".lines", ".data",
+    ".preinit_array", ".init_array", ".fini_array",
+    ".tdata", ".tbss", ".bss",
+};
+
+// the sections of the image, sorted into their load order
+static int *layout;
+
+// the first and last address of each kind of section
+static unsigned int kindstart[LS_KINDS];
+static unsigned int kindend[LS_KINDS];
+static int kindalign[LS_KINDS];
+
+// the two loadable segments and the thread local template
+static unsigned int textsize;
+static unsigned int dataoffset, dataaddr, datafilesize, datamemsize;
+static unsigned int tlsaddr, tlsfilesize, tlsmemsize, tlsalign;
+
+// The global offset table, and the stubs needed to call GNU
+// indirect functions in a static program
+static int gotsection = -1;
+static int ngot = 0;
+static int gotsymbol = -1;
+static int pltsection = -1;
+static int irelsection = -1;
+
+static int roundup(int value, int align)
+{
+    return (value + align - 1) & ~(align - 1);
+}
+
+//////// The pre-linked run time library image
+
+static unsigned char *readwholefile(char *inname, int *size)
+{
+    FILE *input;
+    unsigned char *buffer;
+
+    input = fopen(inname, "rb");
+    if (input == NULL)
+    {
+        perror("Can't open input file");
+        fprintf(stderr, "Can't open input file '%s'\n",inname);
+        exit(1);
+    }
+    fseek(input, 0, SEEK_END);
+    *size = ftell(input);
+    fseek(input, 0, SEEK_SET);
+    buffer = malloc(*size);
+    if ((buffer == NULL) || (fread(buffer, 1, *size, input) != *size))
+    {
+        fprintf(stderr, "Can't read input file '%s'\n",inname);
+        exit(1);
+    }
+    fclose(input);
+    return buffer;
+}
+
+// decide where a section of the run time image belongs
+static int classify(Elf32_Shdr *sh, char *name, int *order)
+{
+    *order = 0;
+    if (strncmp(name, ".imp.trap.", 10) == 0)
+    {
+        *order = (name[10] == 'B') ? LS_ORDERB : (name[10] == 'F') ? LS_ORDERF : LS_ORDERD;
+        return LS_TRAP;
+    }
+    if (strncmp(name, ".imp.line.", 10) == 0)
+    {
+        *order = (name[10] == 'B') ? LS_ORDERB : (name[10] == 'F') ? LS_ORDERF : LS_ORDERD;
+        return LS_LINE;
+    }
+    if (sh->sh_type == SHT_PREINIT_ARRAY)
+        return LS_PREINIT;
+    if (sh->sh_type == SHT_INIT_ARRAY)
+        return LS_INIT;
+    if (sh->sh_type == SHT_FINI_ARRAY)
+        return LS_FINI;
+    if ((sh->sh_flags & SHF_TLS) != 0)
+        return (sh->sh_type == SHT_NOBITS) ? LS_TBSS : LS_TDATA;
+    if ((sh->sh_flags & SHF_EXECINSTR) != 0)
+        return LS_TEXT;
+    if (sh->sh_type == SHT_NOBITS)
+        return LS_BSS;
+    if ((sh->sh_flags & SHF_WRITE) == 0)
+        return LS_RODATA;
+    return LS_DATA;
+}
+
+static void loadruntimeimage(char *inname)
+{
+    unsigned char *image;
+    int size, module, i, n, kind, order, bind, nsyms;
+    int *sectionmap, *symbolmap;
+    Elf32_Ehdr *eh;
+    Elf32_Shdr *sh, *sp;
+    Elf32_Sym *sym;
+    Elf32_Rel *rel;
+    char *shstrings, *strings, *name;
+
+    image = readwholefile(inname, &size);
+    module = newlmodule(inname);
+
+    eh = (Elf32_Ehdr *)image;
+    if ((size < sizeof(Elf32_Ehdr))
+     || (memcmp(eh->e_ident, "\177ELF", 4) != 0)
+     || (eh->e_ident[EI_CLASS] != ELFCLASS32)
+     || (eh->e_ident[EI_DATA] != ELFDATA2LSB)
+     || (eh->e_type != ET_REL)
+     || (eh->e_machine != EM_386))
+    {
+        fprintf(stderr, "'%s' is not an ELF32 i386 relocatable file\n", inname);
+        exit(1);
+    }
+
+    sh = (Elf32_Shdr *)(image + eh->e_shoff);
+    shstrings = (char *)(image + sh[eh->e_shstrndx].sh_offset);
+    sectionmap = malloc(eh->e_shnum * sizeof(int));
+
+    // First, the sections that will be loaded
+    for (i = 0; i < eh->e_shnum; i++)
+    {
+        sp = &sh[i];
+        sectionmap[i] = -1;
+        if ((sp->sh_flags & SHF_ALLOC) == 0)
+            continue;
+        name = shstrings + sp->sh_name;
+        kind = classify(sp, name, &order);
+        sectionmap[i] = newlsection(name, kind, order, sp->sh_addralign, module);
+        if (sp->sh_type == SHT_NOBITS)
+        {
+            // zeroed sections have a size but no contents
+            lsections[sectionmap[i]].size = sp->sh_size;
+        }
+        else
+        {
+            putlbytes(sectionmap[i], image + sp->sh_offset, sp->sh_size);
+        }
+    }
+
+    // Next, the symbols (there is only one symbol table)
+    symbolmap = NULL;
+    nsyms = 0;
+    for (i = 0; i < eh->e_shnum; i++)
+    {
+        sp = &sh[i];
+        if (sp->sh_type != SHT_SYMTAB)
+            continue;
+        nsyms = sp->sh_size / sizeof(Elf32_Sym);
+        strings = (char *)(image + sh[sp->sh_link].sh_offset);
+        symbolmap = malloc(nsyms * sizeof(int));
+        for (n = 0; n < nsyms; n++)
+        {
+            sym = (Elf32_Sym *)(image + sp->sh_offset) + n;
+            name = strings + sym->st_name;
+            bind = sym->st_info >> 4;
+            kind = sym->st_info & 15;
+            symbolmap[n] = -1;
+
+            if (bind == STB_LOCAL)
+            {
+                if (sym->st_shndx == SHN_ABS)
+                    symbolmap[n] = newlocalsymbol(name, LS_ABS, sym->st_value, kind);
+                else if ((sym->st_shndx < eh->e_shnum) && (sectionmap[sym->st_shndx] >= 0))
+                    symbolmap[n] = newlocalsymbol(name, sectionmap[sym->st_shndx], sym->st_value, kind);
+                continue;
+            }
+
+            bind = (bind == STB_WEAK) ? LS_WEAK : LS_GLOBAL;
+            if (sym->st_shndx == SHN_UNDEF)
+            {
+                symbolmap[n] = findglobalsymbol(name);
+                // a weak reference stays weak until someone references it strongly
+                if ((lsymbols[symbolmap[n]].section == LS_UNDEF) && (bind == LS_WEAK))
+                    lsymbols[symbolmap[n]].bind = LS_WEAK;
+            }
+            else if (sym->st_shndx == SHN_ABS)
+            {
+                symbolmap[n] = defineglobalsymbol(name, LS_ABS, sym->st_value, bind, kind);
+            }
+            else if (sym->st_shndx == SHN_COMMON)
+            {
+                symbolmap[n] = defineglobalsymbol(name, LS_COMMON, sym->st_size, bind, STT_OBJECT);
+                if (sym->st_value > lsymbols[symbolmap[n]].align)
+                    lsymbols[symbolmap[n]].align = sym->st_value;
+            }
+            else if ((sym->st_shndx < eh->e_shnum) && (sectionmap[sym->st_shndx] >= 0))
+            {
+                symbolmap[n] = defineglobalsymbol(name, sectionmap[sym->st_shndx], sym->st_value, bind, kind);
+            }
+        }
+    }
+
+    // Finally, the relocations for the loaded sections
+    for (i = 0; i < eh->e_shnum; i++)
+    {
+        sp = &sh[i];
+        if (sp->sh_type == SHT_RELA)
+        {
+            fprintf(stderr, "'%s' has RELA relocations, which are not used on the i386\n", inname);
+            exit(1);
+        }
+        if ((sp->sh_type != SHT_REL) || (sectionmap[sp->sh_info] < 0))
+            continue;
+        for (n = 0; n < (sp->sh_size / sizeof(Elf32_Rel)); n++)
+        {
+            rel = (Elf32_Rel *)(image + sp->sh_offset) + n;
+            if ((rel->r_info & 255) == R_386_NONE)
+                continue;
+            if ((symbolmap == NULL) || ((rel->r_info >> 8) >= nsyms) || (symbolmap[rel->r_info >> 8] < 0))
+            {
+                fprintf(stderr, "Relocation in '%s' refers to an unusable symbol\n",
+                        shstrings + sh[sp->sh_info].sh_name);
+                exit(1);
+            }
+            newlreloc(sectionmap[sp->sh_info], rel->r_offset, rel->r_info & 255, symbolmap[rel->r_info >> 8]);
+        }
+    }
+
+    free(symbolmap);
+    free(sectionmap);
+    free(image);
+}
+
+//////// Symbols the linker would normally provide
+
+// define the symbol (if anyone wants it) at the start of the section
+static void provide(char *name, int section, unsigned int value)
+{
+    int i;
+
+    i = findglobalsymbol(name);
+    if (lsymbols[i].section == LS_UNDEF)
+    {
+        lsymbols[i].section = section;
+        lsymbols[i].value = value;
+        lsymbols[i].bind = LS_GLOBAL;
+    }
+}
+
+// If no module defined the IMP table delimiters, then add
+// empty tables so the run time library still finds its way
+static void providetables()
+{
+    int s;
+
+    if (lsymbols[findglobalsymbol(TRAPBASE)].section == LS_UNDEF)
+    {
+        s = newlsection(".imp.trap.B", LS_TRAP, LS_ORDERB, TRAPENTRYSZ, 0);
+        provide(TRAPBASE, s, 0);
+    }
+    if (lsymbols[findglobalsymbol(TRAPLIMIT)].section == LS_UNDEF)
+    {
+        s = newlsection(".imp.trap.F", LS_TRAP, LS_ORDERF, TRAPENTRYSZ, 0);
+        putlzero(s, TRAPENTRYSZ);
+        provide(TRAPLIMIT, s, 0);
+    }
+    if (lsymbols[findglobalsymbol(LINEBASE)].section == LS_UNDEF)
+    {
+        s = newlsection(".imp.line.B", LS_LINE, LS_ORDERB, LINEHEADERSZ, 0);
+        provide(LINEBASE, s, 0);
+    }
+    if (lsymbols[findglobalsymbol(LINELIMIT)].section == LS_UNDEF)
+    {
+        s = newlsection(".imp.line.F", LS_LINE, LS_ORDERF, LINEHEADERSZ, 0);
+        putlzero(s, LINEHEADERSZ);
+        provide(LINELIMIT, s, 0);
+    }
+}
+
+// allocate space in .bss for any common blocks
+static void allocatecommons()
+{
+    int i, s;
+    unsigned int size;
+
+    s = -1;
+    for (i = 0; i < nlsymbols; i++)
+    {
+        if (lsymbols[i].section != LS_COMMON)
+            continue;
+        if (s < 0)
+            s = newlsection("COMMON", LS_BSS, 0, 16, 0);
+        lsections[s].size = roundup(lsections[s].size, lsymbols[i].align);
+        if (lsymbols[i].align > lsections[s].align)
+            lsections[s].align = lsymbols[i].align;
+        // a common's value is its size until it is given its offset
+        size = lsymbols[i].value;
+        lsymbols[i].section = s;
+        lsymbols[i].value = lsections[s].size;
+        lsections[s].size += size;
+    }
+}
+
+// Work out which symbols need a GOT slot, and give every GNU
+// indirect function a PLT stub with a matching R_386_IRELATIVE
+// record, which the C start-up code applies for a static program
+static void makegot()
+{
+    int i, type, needed;
+    struct lsymbol *sp;
+
+    needed = 0;
+    for (i = 0; i < nlrelocs; i++)
+    {
+        type = lrelocs[i].type;
+        sp = &lsymbols[lrelocs[i].symbol];
+        if ((type == R_386_GOTPC) || (type == R_386_GOTOFF))
+            needed = 1;
+        if ((type == R_386_GOT32) || (type == R_386_GOT32X)
+         || (type == R_386_TLS_IE) || (type == R_386_TLS_GOTIE)
+         || (sp->type == STT_GNU_IFUNC))
+        {
+            needed = 1;
+            if (sp->got == 0)
+            {
+                ngot += 1;
+                sp->got = ngot;
+            }
+        }
+    }
+    if (lsymbols[findglobalsymbol("_GLOBAL_OFFSET_TABLE_")].used != 0)
+        needed = 1;
+    if (needed == 0)
+        return;
+
+    gotsection = newlsection(".got", LS_DATA, 0, 4, 0);
+    putlzero(gotsection, ngot * 4);
+    gotsymbol = findglobalsymbol("_GLOBAL_OFFSET_TABLE_");
+    provide("_GLOBAL_OFFSET_TABLE_", gotsection, 0);
+
+    for (i = 0; i < nlsymbols; i++)
+    {
+        sp = &lsymbols[i];
+        if ((sp->type != STT_GNU_IFUNC) || (sp->got == 0))
+            continue;
+        if (pltsection < 0)
+        {
+            pltsection = newlsection(".iplt", LS_TEXT, 0, 16, 0);
+            irelsection = newlsection(".rel.iplt", LS_RODATA, 0, 4, 0);
+        }
+        // jmp *slot (the address is patched during relocation)
+        putlbytes(pltsection, (unsigned char *)"\xFF\x25\0\0\0\0\x90\x90", 8);
+        putlword(irelsection, 0);
+        putlword(irelsection, R_386_IRELATIVE);
+    }
+    if (irelsection >= 0)
+    {
+        provide("__rel_iplt_start", irelsection, 0);
+        provide("__rel_iplt_end", irelsection, lsections[irelsection].size);
+    }
+}
+
+//////// Layout
+
+static unsigned int placekind(int kind, unsigned int addr)
+{
+    int i, first;
+    struct lsection *sp;
+
+    first = 1;
+    kindalign[kind] = 1;
+    kindstart[kind] = addr;
+    for (i = 0; i < nlsections; i++)
+    {
+        sp = &lsections[layout[i]];
+        if (sp->kind != kind)
+            continue;
+        if (sp->align > kindalign[kind])
+            kindalign[kind] = sp->align;
+        addr = roundup(addr, sp->align);
+        if (first != 0)
+        {
+            kindstart[kind] = addr;
+            first = 0;
+        }
+        sp->addr = addr;
+        addr += sp->size;
+    }
+    kindend[kind] = addr;
+    return addr;
+}
+
+static void layoutimage(int nphdrs)
+{
+    int i;
+    unsigned int addr;
+
+    layout = lsortsections();
+
+    // The text segment begins with the file and program headers
+    addr = IMAGEBASE + sizeof(Elf32_Ehdr) + nphdrs * sizeof(Elf32_Phdr);
+    addr = placekind(LS_TEXT, addr);
+    addr = placekind(LS_RODATA, addr);
+    addr = placekind(LS_TRAP, addr);
+    addr = placekind(LS_LINE, addr);
+    textsize = addr - IMAGEBASE;
+
+    // The data segment starts on a fresh page, at the same
+    // offset in the file as in memory
+    dataoffset = roundup(textsize, PAGESIZE);
+    dataaddr = IMAGEBASE + dataoffset;
+    addr = dataaddr;
+    for (i = LS_DATA; i <= LS_TDATA; i++)
+        addr = placekind(i, addr);
+    datafilesize = addr - dataaddr;
+
+    // The thread local zeroed data takes no space in the image,
+    // it just describes the rest of the thread local template
+    tlsaddr = kindstart[LS_TDATA];
+    tlsfilesize = kindend[LS_TDATA] - kindstart[LS_TDATA];
+    placekind(LS_TBSS, addr);
+    tlsmemsize = kindend[LS_TBSS] - tlsaddr;
+    tlsalign = (kindalign[LS_TDATA] > kindalign[LS_TBSS]) ? kindalign[LS_TDATA] : kindalign[LS_TBSS];
+
+    addr = placekind(LS_BSS, addr);
+    datamemsize = addr - dataaddr;
+}
+
+// The symbols the GNU linker would define for the C start-up code
+static void providelinkersymbols()
+{
+    int i;
+
+    for (i = 0; i < nlsymbols; i++)
+    {
+        if ((lsymbols[i].section != LS_UNDEF) || (lsymbols[i].name == NULL))
+            continue;
+        if ((strcmp(lsymbols[i].name, "__ehdr_start") == 0)
+         || (strcmp(lsymbols[i].name, "__executable_start") == 0))
+        {
+            lsymbols[i].section = LS_ABS;
+            lsymbols[i].value = IMAGEBASE;
+        }
+        else if ((strcmp(lsymbols[i].name, "_etext") == 0)
+              || (strcmp(lsymbols[i].name, "etext") == 0)
+              || (strcmp(lsymbols[i].name, "__etext") == 0))
+        {
+            lsymbols[i].section = LS_ABS;
+            lsymbols[i].value = kindend[LS_TEXT];
+        }
+        else if ((strcmp(lsymbols[i].name, "_edata") == 0)
+              || (strcmp(lsymbols[i].name, "edata") == 0)
+              || (strcmp(lsymbols[i].name, "__bss_start") == 0))
+        {
+            lsymbols[i].section = LS_ABS;
+            lsymbols[i].value = dataaddr + datafilesize;
+        }
+        else if ((strcmp(lsymbols[i].name, "_end") == 0)
+              || (strcmp(lsymbols[i].name, "end") == 0))
+        {
+            lsymbols[i].section = LS_ABS;
+            lsymbols[i].value = dataaddr + datamemsize;
+        }
+        else if (strcmp(lsymbols[i].name, "__preinit_array_start") == 0)
+        {
+            lsymbols[i].section = LS_ABS;
+            lsymbols[i].value = kindstart[LS_PREINIT];
+        }
+        else if (strcmp(lsymbols[i].name, "__preinit_array_end") == 0)
+        {
+            lsymbols[i].section = LS_ABS;
+            lsymbols[i].value = kindend[LS_PREINIT];
+        }
+        else if (strcmp(lsymbols[i].name, "__init_array_start") == 0)
+        {
+            lsymbols[i].section = LS_ABS;
+            lsymbols[i].value = kindstart[LS_INIT];
+        }
+        else if (strcmp(lsymbols[i].name, "__init_array_end") == 0)
+        {
+            lsymbols[i].section = LS_ABS;
+            lsymbols[i].value = kindend[LS_INIT];
+        }
+        else if (strcmp(lsymbols[i].name, "__fini_array_start") == 0)
+        {
+            lsymbols[i].section = LS_ABS;
+            lsymbols[i].value = kindstart[LS_FINI];
+        }
+        else if (strcmp(lsymbols[i].name, "__fini_array_end") == 0)
+        {
+            lsymbols[i].section = LS_ABS;
+            lsymbols[i].value = kindend[LS_FINI];
+        }
+        else if ((strcmp(lsymbols[i].name, "__rel_iplt_start") == 0)
+              || (strcmp(lsymbols[i].name, "__rel_iplt_end") == 0))
+        {
+            // no GNU indirect functions, so an empty table
+            lsymbols[i].section = LS_ABS;
+            lsymbols[i].value = 0;
+        }
+    }
+}
+
+//////// Relocation
+
+// offset of a thread local symbol from the thread pointer
+// (the i386 thread local block sits just below the thread pointer)
+static unsigned int tpoffset(int symbol)
+{
+    return lsymboladdress(symbol) - (tlsaddr + roundup(tlsmemsize, tlsalign));
+}
+
+static void putimageword(unsigned char *p, unsigned int value)
+{
+    p[0] = value & 255;
+    p[1] = (value >> 8) & 255;
+    p[2] = (value >> 16) & 255;
+    p[3] = (value >> 24) & 255;
+}
+
+static unsigned int getimageword(unsigned char *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (p[3] << 24);
+}
+
+static void relocateimage()
+{
+    int i, n, stub;
+    unsigned int got, value, slot;
+    unsigned char *p;
+    struct lreloc *r;
+    struct lsymbol *sp;
+
+    got = (gotsection >= 0) ? lsections[gotsection].addr : 0;
+
+    // fill in the GOT slots, the PLT stubs and their IRELATIVE records
+    stub = 0;
+    for (i = 0; i < nlsymbols; i++)
+    {
+        sp = &lsymbols[i];
+        if (sp->got == 0)
+            continue;
+        slot = got + (sp->got - 1) * 4;
+        if (sp->type == STT_TLS)
+            value = tpoffset(i);
+        else
+            value = lsymboladdress(i);
+        putimageword(&lsections[gotsection].data[(sp->got - 1) * 4], value);
+        if (sp->type == STT_GNU_IFUNC)
+        {
+            putimageword(&lsections[pltsection].data[stub * 8 + 2], slot);
+            putimageword(&lsections[irelsection].data[stub * 8], slot);
+            // calls and address references now go to the stub
+            sp->section = pltsection;
+            sp->value = stub * 8;
+            stub += 1;
+        }
+    }
+
+    for (n = 0; n < nlrelocs; n++)
+    {
+        r = &lrelocs[n];
+        sp = &lsymbols[r->symbol];
+        if (lsections[r->section].data == NULL)
+        {
+            fprintf(stderr, "Relocation in zeroed section '%s'\n", lsections[r->section].name);
+            exit(1);
+        }
+        if (lapplyreloc(r, lsymboladdress(r->symbol)) != 0)
+            continue;
+
+        p = &lsections[r->section].data[r->offset];
+        value = getimageword(p);
+        switch(r->type)
+        {
+        case R_386_GOT32:
+        case R_386_GOT32X:
+            // offset of the GOT slot from the GOT
+            value += (sp->got - 1) * 4;
+            break;
+
+        case R_386_GOTOFF:
+            value += lsymboladdress(r->symbol) - got;
+            break;
+
+        case R_386_GOTPC:
+            value += got - (lsections[r->section].addr + r->offset);
+            break;
+
+        case R_386_TLS_LE:
+            value += tpoffset(r->symbol);
+            break;
+
+        case R_386_TLS_LE_32:
+            value -= tpoffset(r->symbol);
+            break;
+
+        case R_386_TLS_IE:
+            // absolute address of the GOT slot
+            value += got + (sp->got - 1) * 4;
+            break;
+
+        case R_386_TLS_GOTIE:
+            value += (sp->got - 1) * 4;
+            break;
+
+        default:
+            fprintf(stderr, "Relocation type %d in '%s' is not supported\n",
+                    r->type, lsections[r->section].name);
+            fprintf(stderr, "Rebuild the run time image without general dynamic thread local code\n");
+            exit(1);
+        }
+        putimageword(p, value);
+    }
+}
+
+//////// The executable file itself
+
+static FILE *output;
+static unsigned int outoffset = 0;
+
+static void putout(void *data, int count)
+{
+    if (fwrite(data, 1, count, output) != count)
+    {
+        fprintf(stderr, "Can't write the executable file\n");
+        exit(1);
+    }
+    outoffset += count;
+}
+
+// pad the file out to the given offset
+static void padout(unsigned int offset)
+{
+    static unsigned char zero[256];
+    int n;
+
+    while (outoffset < offset)
+    {
+        n = offset - outoffset;
+        if (n > sizeof(zero)) n = sizeof(zero);
+        putout(zero, n);
+    }
+}
+
+// write the sections of kinds first..last in their load order
+static void putkinds(int first, int last, unsigned int fileoffset, unsigned int base)
+{
+    int i;
+    struct lsection *sp;
+
+    for (i = 0; i < nlsections; i++)
+    {
+        sp = &lsections[layout[i]];
+        if ((sp->kind < first) || (sp->kind > last) || (sp->data == NULL) || (sp->size == 0))
+            continue;
+        padout(fileoffset + (sp->addr - base));
+        putout(sp->data, sp->size);
+    }
+    // now the sections with no contents
+    padout(fileoffset + (kindend[last] - base));
+}
+
+// the string table of section names
+static char shstrtab[256];
+static int shstrtabsize = 1;
+
+static int newshname(char *name)
+{
+    strcpy(&shstrtab[shstrtabsize], name);
+    shstrtabsize += strlen(name) + 1;
+    return shstrtabsize - strlen(name) - 1;
+}
+
+static void writeexecutable(char *outname, int nphdrs)
+{
+    Elf32_Ehdr eh;
+    Elf32_Phdr ph;
+    Elf32_Shdr sh;
+    int i, nshdrs, entry;
+    unsigned int shoffset;
+
+    output = fopen(outname, "wb");
+    if (output == NULL)
+    {
+        perror("Can't open output file");
+        fprintf(stderr, "Can't open output file '%s'\n",outname);
+        exit(1);
+    }
+
+    entry = findglobalsymbol(ENTRYNAME);
+    if (lsymbols[entry].section == LS_UNDEF)
+    {
+        fprintf(stderr, "The run time image has no entry point '%s'\n", ENTRYNAME);
+        exit(1);
+    }
+
+    // the section headers go at the end of the file
+    nshdrs = 1 + LS_KINDS + 1;
+    shoffset = roundup(dataoffset + datafilesize, 4);
+
+    memset(&eh, 0, sizeof(eh));
+    memcpy(eh.e_ident, "\177ELF", 4);
+    eh.e_ident[EI_CLASS] = ELFCLASS32;
+    eh.e_ident[EI_DATA] = ELFDATA2LSB;
+    eh.e_ident[EI_VERSION] = EV_CURRENT;
+    eh.e_type = ET_EXEC;
+    eh.e_machine = EM_386;
+    eh.e_version = EV_CURRENT;
+    eh.e_entry = lsymboladdress(entry);
+    eh.e_phoff = sizeof(Elf32_Ehdr);
+    eh.e_shoff = shoffset;
+    eh.e_ehsize = sizeof(Elf32_Ehdr);
+    eh.e_phentsize = sizeof(Elf32_Phdr);
+    eh.e_phnum = nphdrs;
+    eh.e_shentsize = sizeof(Elf32_Shdr);
+    eh.e_shnum = nshdrs;
+    eh.e_shstrndx = nshdrs - 1;
+    putout(&eh, sizeof(eh));
+
+    // the read-only (text) segment, including the headers
+    memset(&ph, 0, sizeof(ph));
+    ph.p_type = PT_LOAD;
+    ph.p_offset = 0;
+    ph.p_vaddr = IMAGEBASE;
+    ph.p_paddr = IMAGEBASE;
+    ph.p_filesz = textsize;
+    ph.p_memsz = textsize;
+    ph.p_flags = PF_R | PF_X;
+    ph.p_align = PAGESIZE;
+    putout(&ph, sizeof(ph));
+
+    // the writable (data) segment
+    ph.p_offset = dataoffset;
+    ph.p_vaddr = dataaddr;
+    ph.p_paddr = dataaddr;
+    ph.p_filesz = datafilesize;
+    ph.p_memsz = datamemsize;
+    ph.p_flags = PF_R | PF_W;
+    putout(&ph, sizeof(ph));
+
+    // no executable stack
+    memset(&ph, 0, sizeof(ph));
+    ph.p_type = PT_GNU_STACK;
+    ph.p_flags = PF_R | PF_W;
+    ph.p_align = 16;
+    putout(&ph, sizeof(ph));
+
+    // the thread local template
+    if (nphdrs == 4)
+    {
+        ph.p_type = PT_TLS;
+        ph.p_offset = dataoffset + (tlsaddr - dataaddr);
+        ph.p_vaddr = tlsaddr;
+        ph.p_paddr = tlsaddr;
+        ph.p_filesz = tlsfilesize;
+        ph.p_memsz = tlsmemsize;
+        ph.p_flags = PF_R;
+        ph.p_align = tlsalign;
+        putout(&ph, sizeof(ph));
+    }
+
+    putkinds(LS_TEXT, LS_LINE, 0, IMAGEBASE);
+    padout(dataoffset);
+    putkinds(LS_DATA, LS_TDATA, dataoffset, dataaddr);
+    padout(shoffset);
+
+    // one section header for each kind of section (so objdump
+    // and the debugger can find their way around), then the names
+    memset(&sh, 0, sizeof(sh));
+    putout(&sh, sizeof(sh));
+    for (i = 0; i < LS_KINDS; i++)
+    {
+        memset(&sh, 0, sizeof(sh));
+        sh.sh_name = newshname(kindname[i]);
+        sh.sh_type = SHT_PROGBITS;
+        sh.sh_flags = SHF_ALLOC;
+        if (i == LS_TEXT) sh.sh_flags |= SHF_EXECINSTR;
+        if (i >= LS_DATA) sh.sh_flags |= SHF_WRITE;
+        if ((i == LS_TDATA) || (i == LS_TBSS)) sh.sh_flags |= SHF_TLS;
+        if (i == LS_PREINIT) sh.sh_type = SHT_PREINIT_ARRAY;
+        if (i == LS_INIT) sh.sh_type = SHT_INIT_ARRAY;
+        if (i == LS_FINI) sh.sh_type = SHT_FINI_ARRAY;
+        if ((i == LS_TBSS) || (i == LS_BSS)) sh.sh_type = SHT_NOBITS;
+        sh.sh_addr = kindstart[i];
+        sh.sh_size = kindend[i] - kindstart[i];
+        if (i < LS_DATA)
+            sh.sh_offset = kindstart[i] - IMAGEBASE;
+        else
+            sh.sh_offset = dataoffset + (kindstart[i] - dataaddr);
+        sh.sh_addralign = kindalign[i];
+        putout(&sh, sizeof(sh));
+    }
+    memset(&sh, 0, sizeof(sh));
+    sh.sh_name = newshname(".shstrtab");
+    sh.sh_type = SHT_STRTAB;
+    sh.sh_offset = shoffset + nshdrs * sizeof(Elf32_Shdr);
+    sh.sh_size = shstrtabsize;
+    sh.sh_addralign = 1;
+    putout(&sh, sizeof(sh));
+    putout(shstrtab, shstrtabsize);
+
+    fclose(output);
+
+    // and finally, make it runnable
+    chmod(outname, 0755);
+}
+
+int main(int argc, char **argv)
+{
+    int i, nphdrs;
+
+    if (argc < 4)
+    {
+        fprintf(stderr, "Unexpected number of parameters for PASS3EXE!\n\n");
+        fprintf(stderr, "Usage:  PASS3EXE <executable> <runtimeimage> <intermediatefile> ...\n");
+        exit(1);
+    }
+
+    // Within each group of trap/line tables the modules keep the
+    // order they are loaded, so the run time library comes first
+    loadruntimeimage(argv[2]);
+    for (i = 3; i < argc; i++)
+        loadibjmodule(argv[i]);
+
+    providetables();
+    allocatecommons();
+    makegot();
+
+    // we need a PT_TLS header if there is any thread local data
+    nphdrs = 3;
+    for (i = 0; i < nlsections; i++)
+        if ((lsections[i].kind == LS_TDATA) || (lsections[i].kind == LS_TBSS))
+            nphdrs = 4;
+
+    layoutimage(nphdrs);
+    providelinkersymbols();
+
+    if (lundefined(1) != 0)
+    {
+        fprintf(stderr, "Executable '%s' not written\n", argv[1]);
+        exit(1);
+    }
+    relocateimage();
+    writeexecutable(argv[1], nphdrs);
+
+    fprintf(stderr, "\n\n");
+    fprintf(stderr, " ELF executable generated: '%s'\n", argv[1]);
+    fprintf(stderr, " +----------+----------+----------+---------+---------+---------+------------+\n");
+    fprintf(stderr, " | Modules  | Sections | Symbols  | Code    | Data    | Diag    | Total size |\n");
+    fprintf(stderr, " |  (count) |  (count) |  (count) | (bytes) | (bytes) | (bytes) | (bytes)    |\n");
+    fprintf(stderr, " +----------+----------+----------+---------+---------+---------+------------+\n");
+    fprintf(stderr, " | %8d | %8d | %8d | %7d | %7d | %7d | %10d |\n",
+                    nlmodules,
+                    nlsections,
+                    nlsymbols,
+                    kindend[LS_TEXT] - kindstart[LS_TEXT],
+                    (kindend[LS_RODATA] - kindstart[LS_RODATA]) + datamemsize,
+                    kindend[LS_LINE] - kindstart[LS_TRAP],
+                    textsize + datamemsize);
+    fprintf(stderr, " +----------+----------+----------+---------+---------+---------+------------+\n");
+    fprintf(stderr, "\n\n");
+
+    exit(0);
+}
@@ -0,0 +1,288 @@
+// IMP Compiler for 80386 - pass 3
+// In-memory loader - run an IMP program straight from its .ibj file(s)
+
+// This is built together with the whole of the run time library.
+// The intermediate object files produced by the second pass are
+// reduced to sections, symbols and relocations (just as pass3exe
+// does), then placed in memory obtained from mmap.  References to
+// the run time library (or the C library) are bound to the copies
+// already loaded in this program, using dlsym.  The program's trap
+// and line tables are handed to the run time system, so that %signal
+// and the diagnostic traceback work for the loaded code too.
+// Finally the run time start-up (StartImp) is entered as usual, and
+// its call of "__impmain" is passed on to the loaded program.
+//
+// No object file is written and no linker is run.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <dlfcn.h>
+#include "pass3core.h"
+#include "pass3elf.h"
+#include "ibjlink.h"
+
+#define PAGESIZE        0x1000
+#define LINEHEADERSZ   256
+
+#define ENTRYNAME       "__impmain"
+
+// The run time start-up routine StartImp, which is renamed from
+// "main" in the copy of imprtl-main built into this program
+extern void _imp_startimp(int argc, char **argv, char **envp);
+
+// Where the run time looks for the tables of a loaded program.
+// They are weak so that the loader still works (without trap and
+// line information) if the run time library predates them.
+extern int _imp_loadedtrapbase __attribute__((weak));
+extern int _imp_loadedtraplimit __attribute__((weak));
+extern int _imp_loadedlinebase __attribute__((weak));
+extern int _imp_loadedlinelimit __attribute__((weak));
+
+// the sections of the image, sorted into their load order
+static int *layout;
+
+// the first and last address of each kind of section
+static unsigned int kindstart[LS_KINDS];
+static unsigned int kindend[LS_KINDS];
+
+// the memory holding the image, and the size of its code part
+static unsigned char *image;
+static unsigned int imagesize, textsize;
+
+// the empty line table header which ends the loaded line tables
+static int lineend;
+
+// the loaded program's entry point
+static void (*entrypoint)(void);
+
+static int roundup(int value, int align)
+{
+    return (value + align - 1) & ~(align - 1);
+}
+
+//////// Loading
+
+// The first parameter is a comma separated list of .ibj files
+static void loadprogram(char *list)
+{
+    char *name, *comma;
+
+    name = list;
+    while (name != NULL)
+    {
+        comma = strchr(name, ',');
+        if (comma != NULL)
+            *comma++ = 0;
+        if (*name != 0)
+            loadibjmodule(name);
+        name = comma;
+    }
+
+    if (nlmodules == 0)
+    {
+        fprintf(stderr, "No intermediate files to load\n");
+        exit(1);
+    }
+
+    // The run time walks a line table up to an empty header
+    lineend = newlsection(".imp.line.F", LS_LINE, LS_ORDERF, LINEHEADERSZ, nlmodules - 1);
+    putlzero(lineend, LINEHEADERSZ);
+}
+
+// Bind each external the program uses to the copy in this program
+static void bindexternals()
+{
+    int i;
+    void *p;
+    struct lsymbol *sp;
+
+    for (i = 0; i < nlsymbols; i++)
+    {
+        sp = &lsymbols[i];
+        if ((sp->section != LS_UNDEF) || (sp->used == 0))
+            continue;
+        p = dlsym(RTLD_DEFAULT, sp->name);
+        if ((p != NULL) || (sp->bind == LS_WEAK))
+        {
+            sp->section = LS_ABS;
+            sp->value = (unsigned int)p;
+        }
+    }
+}
+
+//////// Layout
+
+static unsigned int placekind(int kind, unsigned int addr)
+{
+    int i, first;
+    struct lsection *sp;
+
+    first = 1;
+    kindstart[kind] = addr;
+    for (i = 0; i < nlsections; i++)
+    {
+        sp = &lsections[layout[i]];
+        if (sp->kind != kind)
+            continue;
+        addr = roundup(addr, sp->align);
+        if (first != 0)
+        {
+            kindstart[kind] = addr;
+            first = 0;
+        }
+        sp->addr = addr;
+        addr += sp->size;
+    }
+    kindend[kind] = addr;
+    return addr;
+}
+
+static void layoutimage()
+{
+    int i;
+    unsigned int addr;
+
+    // An .ibj module has no start-up arrays or thread local data
+    for (i = 0; i < nlsections; i++)
+    {
+        if ((lsections[i].size != 0) && (LS_PREINIT <= lsections[i].kind) && (lsections[i].kind <= LS_TBSS))
+        {
+            fprintf(stderr, "Section '%s' can't be loaded by PASS3RUN\n", lsections[i].name);
+            exit(1);
+        }
+    }
+
+    layout = lsortsections();
+
+    // Work out the offsets first, then move everything to wherever
+    // the memory is given to us
+    addr = 0;
+    addr = placekind(LS_TEXT, addr);
+    addr = placekind(LS_RODATA, addr);
+    addr = placekind(LS_TRAP, addr);
+    addr = placekind(LS_LINE, addr);
+    textsize = roundup(addr, PAGESIZE);
+
+    // The writable part starts on a fresh page
+    addr = placekind(LS_DATA, textsize);
+    addr = placekind(LS_BSS, addr);
+    imagesize = roundup(addr, PAGESIZE);
+
+    image = mmap(NULL, imagesize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (image == MAP_FAILED)
+    {
+        fprintf(stderr, "Can't get %u bytes of memory for the program\n", imagesize);
+        exit(1);
+    }
+
+    for (i = 0; i < nlsections; i++)
+        lsections[i].addr += (unsigned int)image;
+    for (i = 0; i < LS_KINDS; i++)
+    {
+        kindstart[i] += (unsigned int)image;
+        kindend[i] += (unsigned int)image;
+    }
+}
+
+//////// Relocation and loading
+
+static void relocateimage()
+{
+    int i;
+    struct lreloc *r;
+
+    for (i = 0; i < nlrelocs; i++)
+    {
+        r = &lrelocs[i];
+        if (lapplyreloc(r, lsymboladdress(r->symbol)) == 0)
+        {
+            fprintf(stderr, "Relocation type %d for '%s' can't be handled by PASS3RUN\n",
+                            r->type, lsymbols[r->symbol].name);
+            exit(1);
+        }
+    }
+}
+
+static void copyimage()
+{
+    int i;
+    struct lsection *sp;
+
+    // zeroed sections are already clear in the fresh memory
+    for (i = 0; i < nlsections; i++)
+    {
+        sp = &lsections[i];
+        if ((sp->data != NULL) && (sp->size != 0))
+            memcpy((void *)sp->addr, sp->data, sp->size);
+    }
+
+    // The code part is never written again
+    if (mprotect(image, textsize, PROT_READ | PROT_EXEC) != 0)
+    {
+        fprintf(stderr, "Can't make the loaded program executable\n");
+        exit(1);
+    }
+}
+
+// Tell the run time system where the loaded tables are
+static void registertables()
+{
+    if (&_imp_loadedtrapbase == NULL)
+        return;
+
+    _imp_loadedtrapbase = kindstart[LS_TRAP];
+    _imp_loadedtraplimit = kindend[LS_TRAP];
+    _imp_loadedlinebase = kindstart[LS_LINE];
+    _imp_loadedlinelimit = lsections[lineend].addr;
+}
+
+//////// Running
+
+// StartImp calls "__impmain" once the I/O system has been set up,
+// so this passes control on to the loaded program.
+// (This must keep a frame pointer, as the event traceback walks
+// the %ebp chain through here back to StartImp)
+void __impmain(void)
+{
+    entrypoint();
+}
+
+int main(int argc, char **argv, char **envp)
+{
+    int entry;
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "Unexpected number of parameters for PASS3RUN!\n\n");
+        fprintf(stderr, "Usage:  PASS3RUN <intermediatefile>[,<intermediatefile>...] [<program parameters>]\n");
+        exit(1);
+    }
+
+    loadprogram(argv[1]);
+    bindexternals();
+    if (lundefined(1) != 0)
+    {
+        fprintf(stderr, "Program '%s' not run\n", argv[1]);
+        exit(1);
+    }
+
+    entry = findglobalsymbol(ENTRYNAME);
+    if (lsymbols[entry].section < 0)
+    {
+        fprintf(stderr, "No IMP program (%s) found in '%s'\n", ENTRYNAME, argv[1]);
+        exit(1);
+    }
+
+    layoutimage();
+    relocateimage();
+    copyimage();
+    registertables();
+    entrypoint = (void (*)(void))lsymboladdress(entry);
+
+    // The loaded program sees the .ibj list as its own name
+    _imp_startimp(argc - 1, argv + 1, envp);
+
+    exit(0);
+}
@@ -0,0 +1,43 @@
+// pass3exe: common blocks of different sizes are laid out one after
+// another, each at its own offset, and the section holds them all
+//
+// pass3exe.c is included so as to reach its static routines
+
+#define main pass3exe_main
+#include "../pass3exe.c"
+#undef main
+
+static int failures = 0;
+
+static void expect(char *what, unsigned int got, unsigned int wanted)
+{
+    if (got != wanted)
+    {
+        fprintf(stderr, "commons: %s is %u, not %u\n", what, got, wanted);
+        failures++;
+    }
+}
+
+int main()
+{
+    int a, b, c;
+
+    a = defineglobalsymbol("a", LS_COMMON, 100, LS_GLOBAL, STT_OBJECT);
+    lsymbols[a].align = 4;
+    b = defineglobalsymbol("b", LS_COMMON, 8, LS_GLOBAL, STT_OBJECT);
+    lsymbols[b].align = 8;
+    c = defineglobalsymbol("c", LS_COMMON, 3000, LS_GLOBAL, STT_OBJECT);
+    lsymbols[c].align = 16;
+
+    allocatecommons();
+
+    expect("a's offset", lsymbols[a].value, 0);
+    expect("b's offset", lsymbols[b].value, 104);
+    expect("c's offset", lsymbols[c].value, 112);
+    expect("the section's size", lsections[lsymbols[c].section].size, 3112);
+    expect("the section's alignment", lsections[lsymbols[c].section].align, 16);
+
+    if (failures == 0)
+        printf("commons: passed\n");
+    return failures != 0;
+}
@@ -0,0 +1,116 @@
+// ibjprof: code is moved out of line in a plain routine, but nothing
+// is moved in a routine with an event handler ("%on %event"), as it
+// could land between the handler's trap entry and its end
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../pass3core.h"
+#include "../ibjprof.h"
+
+#define PROFNAME "tests/onevent.prof"
+
+static int failures = 0;
+
+static void putword(int type, int w)
+{
+    unsigned char b[2];
+
+    b[0] = w & 255;
+    b[1] = (w >> 8) & 255;
+    putifrecord(type, 2, b);
+}
+
+// %if ... %then A %else B, where the jump to B is mostly taken
+static void putroutine(int id, int events)
+{
+    unsigned char b[10];
+
+    putword(IF_FIXUP, id);
+    putifrecord(IF_OBJ, 1, (unsigned char *)"\x90");
+    b[0] = 0;
+    b[1] = 10*id;
+    b[2] = 0;
+    putifrecord(IF_JCOND, 3, b);
+    putifrecord(IF_OBJ, 1, (unsigned char *)"\x40");
+    putword(IF_JUMP, 10*id + 1);
+    putword(IF_LABEL, 10*id);
+    putifrecord(IF_OBJ, 1, (unsigned char *)"\x48");
+    putword(IF_LABEL, 10*id + 1);
+    putifrecord(IF_OBJ, 1, (unsigned char *)"\xC3");
+
+    memset(b, 0, sizeof(b));
+    b[0] = id;
+    b[2] = 0xF0;
+    b[3] = 0xFF;
+    if (events)
+    {
+        b[4] = 0x02;           // the event mask
+        b[6] = 10*id + 2;      // the trap entry
+        b[8] = 10*id + 3;      // the end of the handler
+    }
+    putifrecord(IF_SETFIX, 10, b);
+}
+
+// The first code after the conditional jump in routine id
+static int afterjump(int id)
+{
+    int type, length, state;
+    unsigned char buffer[256];
+
+    rewindifstore();
+    state = 0;
+    for (;;)
+    {
+        readifrecord(NULL, &type, &length, buffer);
+        if (type < 0)
+            return -1;
+        if ((state == 0) && (type == IF_FIXUP) && (buffer[0] == id))
+            state = 1;
+        else if ((state == 1) && (type == IF_JCOND))
+            state = 2;
+        else if ((state == 2) && (type == IF_OBJ))
+            return buffer[0];
+    }
+}
+
+static void expect(char *what, int got, int wanted)
+{
+    if (got != wanted)
+    {
+        fprintf(stderr, "onevent: %s is %d, not %d\n", what, got, wanted);
+        failures++;
+    }
+}
+
+int main()
+{
+    FILE *prof;
+
+    clearifstore();
+    putifrecord(IF_SOURCE, 7, (unsigned char *)"onevent");
+    putroutine(1, 0);
+    putroutine(2, 1);
+
+    // both jumps reached 100 times and never falling through
+    prof = fopen(PROFNAME, "w");
+    if (prof == NULL)
+    {
+        perror("onevent: can't make the profile");
+        return 1;
+    }
+    fprintf(prof, "module 2 onevent\n100 0\n100 0\n");
+    fclose(prof);
+
+    profileibj(NULL, PROF_LAYOUT, PROFNAME);
+    remove(PROFNAME);
+
+    // routine 1 runs straight on into the else part
+    expect("the code after the plain routine's jump", afterjump(1), 0x48);
+    // routine 2 is left as it was
+    expect("the code after the trapping routine's jump", afterjump(2), 0x40);
+
+    if (failures == 0)
+        printf("onevent: passed\n");
+    return failures != 0;
+}
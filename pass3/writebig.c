@@ -9,10 +9,10 @@
 #include <stdio.h>
 #include "pass3core.h"
 
-#define NSECTIONS 20
+#define NSECTIONS 24
 // section specific data
-static int fileptr[NSECTIONS] = {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0};
-static int size[NSECTIONS] = {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0};
+static int fileptr[NSECTIONS] = {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0};
+static int size[NSECTIONS] = {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0};
 
 // our buffer data structure is designed to scale to allow rather more
 // sections that we might sensibly provide buffers for...  We use the
@@ -51,6 +51,22 @@ void setsize(int section, int s)
     }
 }
 
+// forget the sections of the last file, so that another can be
+// written by the same process
+void resetsections()
+{
+    int i;
+
+    for(i=0; i<NSECTIONS; i++)
+    {
+        fileptr[i] = 0;
+        size[i] = 0;
+    }
+    nextbuf = 0;
+    fileoffset = 0;
+    output = NULL;
+}
+
 // routine to describe the output file.  Must be called to
 // initialise the output process.
 void setfile(FILE * out, int offset)